@@ -17,10 +17,22 @@
  *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <cctype>
+#include <cmath>
+#include <new>
+#include <unistd.h>
+
 #include "common.hpp"
+#include "logsumexp.hpp"
+#include "stats.hpp"
 
 void find_global_optimum();
 void sampling(const char **argv);
+void count_trees();
+void kbest(const char **argv);
+void serve(const char **argv);
+void update(const char **argv);
+void edge_marginals(const char **argv);
 
 
 int read_flags(const char *flags)
@@ -30,6 +42,11 @@ int read_flags(const char *flags)
 	opt_output_edge_estimates = 0;
 	opt_naive_sampling = 0;
 	opt_output_sample_times = 0;
+	opt_bottom_up = 0;
+	opt_subset_convolution = 0;
+	opt_branch_and_bound = 0;
+	opt_argmax = 0;
+	opt_single_precision = 0;
 	
 	if (strlen(flags) > 16) {
 		printf("Error: Too any input flags.\n");
@@ -50,6 +67,17 @@ int read_flags(const char *flags)
 			opt_naive_sampling = 1;
 		} else if (f == 'T') {
 			opt_output_sample_times = 1;
+		} else if (f == 'b') {
+			opt_bottom_up = 1;
+		} else if (f == 'z') {
+			opt_bottom_up = 1;
+			opt_subset_convolution = 1;
+		} else if (f == 'p') {
+			opt_branch_and_bound = 1;
+		} else if (f == 'a') {
+			opt_argmax = 1;
+		} else if (f == 'f') {
+			opt_single_precision = 1;
 		} else if (!strchr("sjrtmdck", f)) {
 			printf("Error: Unknown flag: %c\n\n", f);
 			return 0;
@@ -60,15 +88,105 @@ int read_flags(const char *flags)
 	return 1;
 }
 
+// reads an option of the form --name=value
+int read_option(const char *option)
+{
+	const char *value = strchr(option, '=');
+	if (value == NULL) {
+		printf("Error: Option without a value: %s\n\n", option);
+		return 0;
+	}
+	value++;
+	
+	if (!strncmp(option, "--threads=", value - option)) {
+		int threads = atoi(value);
+		if (threads < 1) {
+			printf("Error: The number of threads must be at least 1.\n\n");
+			return 0;
+		}
+		opt_threads = threads;
+	} else if (!strncmp(option, "--procs=", value - option)) {
+		int procs = atoi(value);
+		if (procs < 1) {
+			printf("Error: The number of processes must be at least 1.\n\n");
+			return 0;
+		}
+		opt_procs = procs;
+	} else if (!strncmp(option, "--incumbent=", value - option)) {
+		opt_incumbent = value;
+	} else if (!strncmp(option, "--scratch=", value - option)) {
+		opt_scratch_directory = value;
+	} else if (!strncmp(option, "--logsum=", value - option)) {
+		if (!select_logsumexp(value)) {
+			printf("Error: Unknown log-sum-exp mode: %s\n\n", value);
+			return 0;
+		}
+	} else if (!strncmp(option, "--mem-limit=", value - option)) {
+		char *unit;
+		double limit = strtod(value, &unit);
+		const char *units = "KMGT";
+		const char *u = *unit != '\0' ? strchr(units, toupper(*unit)) : NULL;
+		if (u != NULL) limit *= pow(1024, u - units + 1);
+		if (limit <= 0 || (*unit != '\0' && u == NULL)) {
+			printf("Error: Invalid memory limit: %s\n\n", value);
+			return 0;
+		}
+		opt_memory_limit = limit;
+	} else if (!strncmp(option, "--stats=", value - option)) {
+		if (!select_stats(value)) {
+#ifdef ADJUNCT_STATS
+			printf("Error: Unknown statistics format: %s\n\n", value);
+#else
+			printf("Error: Statistics are only collected when built by make stats.\n\n");
+#endif
+			return 0;
+		}
+	} else if (!strncmp(option, "--save-tables=", value - option)) {
+		opt_save_tables = value;
+	} else if (!strncmp(option, "--load-tables=", value - option)) {
+		opt_load_tables = value;
+	} else {
+		printf("Error: Unknown option: %s\n\n", option);
+		return 0;
+	}
+	
+	return 1;
+}
+
 void print_usage(const char *cmd)
 {
-	printf("Usage: %s [-flags] <input file> [<maximum width>] [<action [arg ...]>]\n", cmd);
-	printf("\nAn action is one of: max, sample, tree, file, enum (default is max).\n");
+	printf("Usage: %s [--options] [-flags] <input file> [<maximum width>] [<action [arg ...]>]\n", cmd);
+	printf("\nAn action is one of: max, kbest, sample, tree, file, enum, edges, count,\n");
+	printf("serve, update (default is max).\n");
 	printf(" max                    find the maximum-a-posteriori graph\n");
+	printf(" kbest <k> [graphs|trees]\n");
+	printf("                        find the k best distinct graphs (default) or junction trees\n");
 	printf(" sample [<n> [<seed>]]  sample n junction trees with given RNG seed\n");
 	printf(" tree <tree string>     parse the given tree in the compact form (-c)\n");
 	printf(" file <tree file>       parse each tree in file in the compact form (-c)\n");
 	printf(" enum                   enumerate all decomposable graphs, get edge probabilities\n");
+	printf(" edges                  compute the edge probabilities over RPTs exactly by an\n");
+	printf("                        outside pass over the sum tables (graphs with more RPTs\n");
+	printf("                        weigh more than in enum; sample -e corrects for it)\n");
+	printf(" count                  count all RPTs (rooted partition trees) exactly\n");
+	printf(" serve [<socket>]       compute the tables once and answer requests, one per\n");
+	printf("                        line, on a Unix domain socket or else on stdin:\n");
+	printf("                          sample [<n> [<seed>]]  n trees (score, compact form)\n");
+	printf("                          max                    a maximum-a-posteriori tree\n");
+	printf("                          score <tree>           the score of a compact tree\n");
+	printf("                          edges                  edge probabilities over RPTs\n");
+	printf("                                                 as with edges (computed once)\n");
+	printf("                          edges <n> [<seed>]     edge probabilities estimated\n");
+	printf("                                                 from n samples as with -e\n");
+	printf("                          quit, stop             close, stop the server\n");
+	printf("                        Answers are \"ok <k>\" and k lines, or \"error ...\".\n");
+	printf(" update <changes file> [max|sum]\n");
+	printf("                        change the local scores of the sets in file (lines of\n");
+	printf("                        a set as an integer and its score), recompute only the\n");
+	printf("                        entries that depend on them, print the optimal graph\n");
+	printf("                        and the total score, or only one of them; the tables\n");
+	printf("                        of one can be loaded for the old scores and saved for\n");
+	printf("                        the new ones\n");
 	printf("\nFlags control what is printed for each resulting graph/tree:\n");
 	printf(" s:  score\n");
 	printf(" k:  cliques and separators\n");
@@ -83,8 +201,46 @@ void print_usage(const char *cmd)
 	printf(" v:  verbose, print information on computation progress\n");
 	printf(" e:  in sampling, print estimates of edge probabilities\n");
 	printf(" n:  use naive sampling (instead of adaptive)\n");
+	printf(" b:  fill the DP tables bottom-up (instead of top-down)\n");
+	printf(" z:  fill g of the sum and count tables by fast subset convolution (implies -b);\n");
+	printf("     the max tables of max and kbest have no subtraction for it and are filled\n");
+	printf("     by the exact sums\n");
+	printf(" p:  in max, prune the search by branch and bound (top-down, single thread)\n");
+	printf(" a:  in max, record the maximizing choice of each entry for exact backtracking\n");
+	printf("     in linear time (4 more bytes per entry)\n");
+	printf(" f:  in max and sampling, store the DP tables in single precision (half the\n");
+	printf("     memory) with the arithmetic in double, and report the error bound\n");
 // 	printf(" T:  measure and print sampling time\n");
 	printf("\nThe default flags are -ksthv\n");
+	printf("\nOptions:\n");
+	printf(" --threads=<n>          compute the DP tables using n threads, top-down with work\n");
+	printf("                        stealing or bottom-up level by level (-b)\n");
+	printf(" --procs=<p>            fill the DP tables bottom-up (implies -b) in p processes\n");
+	printf("                        sharing them in shared memory, each pinned to its own\n");
+	printf("                        group of CPUs (e.g. one per socket) and using the\n");
+	printf("                        threads given by --threads\n");
+	printf(" --incumbent=<tree>     start branch and bound (-p) from a tree in the compact\n");
+	printf("                        form (default: a greedy spanning forest)\n");
+	printf(" --scratch=<dir>        keep the DP tables in memory-mapped scratch files in\n");
+	printf("                        dir, e.g. on a local SSD, if they do not fit in memory;\n");
+	printf("                        best with -b, and -v reports the time spent on I/O\n");
+	printf(" --mem-limit=<size>     plan the memory of the run (e.g. 8G) before allocating:\n");
+	printf("                        store the tables in single precision or in scratch\n");
+	printf("                        files if they do not fit, or else report the largest\n");
+	printf("                        maximum width that does (-v prints the plan)\n");
+	printf(" --save-tables=<file>   save the DP tables of max, kbest, sample, count or update\n");
+	printf("                        to file (complete with -b, computed entries only\n");
+	printf("                        otherwise)\n");
+	printf(" --load-tables=<file>   map the DP tables back from file instead of computing\n");
+	printf("                        them; the scores, maximum width and --logsum must be\n");
+	printf("                        the same (in serve, both options apply to the sum tables)\n");
+	printf(" --logsum=<mode>        how sums are taken in log space in the sum tables:\n");
+	printf("                        exact (default) with AVX-512 or AVX2 if available,\n");
+	printf("                        fast with a relative error of 2e-8 per term, both giving\n");
+	printf("                        the same results on every processor, or scalar by exp()\n");
+	printf(" --stats=<format>       report the calls, cache hits and terms of each table,\n");
+	printf("                        its entries filled and allocated, and the time of each\n");
+	printf("                        phase to stderr as text or json (built by make stats)\n");
 	printf("\nExamples:\n");
 	printf("\n%s bridges.score\n", cmd);
 	printf("Find a maximum-a-posteriori graph for bridges.score.\n");
@@ -92,13 +248,26 @@ void print_usage(const char *cmd)
 	printf("Find a maximum-a-posteriori graph of maximum width 2.\n");
 	printf("\n%s -the bridges.score sample 10\n", cmd);
 	printf("Sample and print 10 junction trees and estimate edge probabilities.\n");
+	printf("\n%s --threads=8 -sb bridges.score\n", cmd);
+	printf("Fill the max tables bottom-up using 8 threads and print the optimal score.\n");
+	printf("\n%s --threads=8 -s bridges.score 2 max\n", cmd);
+	printf("Compute only the max table entries needed for width 2, using 8 threads.\n");
+	printf("\n%s --threads=8 -cb bridges.score sample 10 1\n", cmd);
+	printf("Fill the sum tables in parallel and sample 10 trees with seed 1. The samples\n");
+	printf("do not depend on the number of threads.\n");
+	printf("\n%s -spv bridges.score 3 max\n", cmd);
+	printf("Find a graph of maximum width 3 by branch and bound, reporting the entries evaluated.\n");
+	printf("\n%s -sc bridges.score 3 kbest 5\n", cmd);
+	printf("Print the scores of the 5 best graphs of maximum width 3.\n");
 	printf("\n%s -s bridges.score tree 3{22}{513{1792{2304{2056{40}}{2176}}{320}}}\n", cmd);
 	printf("Print the score of the input tree.\n");
 }
 
 // Sets N, W and local_scores values
-int read_data(const char *input_file, const char *max_width)
+int read_data(const char *input_file, const char *max_width, const char **action)
 {
+	STAT_PHASE(PHASE_READ);
+	
 	FILE *f = fopen(input_file, "r");
 	if (f == NULL) {
 		printf("Error: The input file could not be read.\n");
@@ -130,7 +299,6 @@ int read_data(const char *input_file, const char *max_width)
 		return 1;
 	}
 	
-	unsigned M;
 	if (fscanf(f, "%u", &M) != 1) {
 		printf("Error: Could not read the maximum set size.\n");
 		return 1;
@@ -139,7 +307,8 @@ int read_data(const char *input_file, const char *max_width)
 	vbprintf("  Scores up to set size: %u\n", M);
 	
 	if (N > MAX_SET_SIZE || M > MAX_SET_SIZE) {
-		printf("Error: Junctor can only handle instances of up to %i variables.\n", MAX_SET_SIZE);
+		printf("Error: Junctor can only handle instances of up to %i variables%s.\n", MAX_SET_SIZE,
+			MAX_SET_SIZE < 64 ? " (64 when built by make wide)" : "");
 		return 1;
 	}
 	
@@ -157,19 +326,20 @@ int read_data(const char *input_file, const char *max_width)
 		W = M;
 	}
 	
-	vbprintf("Reading input scores...\n");
+	range_k_iterator<Set>::init(N);
 	
-	local_scores = new double[1 << N];
+	if (opt_memory_limit > 0 ? plan_memory(action) : check_memory(action)) return 1;
 	
-	range_k_iterator<Set>::init(N);
+	vbprintf("Reading input scores...\n");
+	
+	local_scores = new double[set_indices(N, M)];
 	
 	for (range_k_iterator<Set> it(N, M, Set::empty(N), Set::complete(N)); it.has_next(); ++it) {
-		if (fscanf(f, "%lf", &local_scores[it.set().bits]) != 1) {
+		if (fscanf(f, "%lf", &local_score(it.set())) != 1) {
 			vbprintf("Error: The input file contains too few scores. No score for: ");
 			it.set().rprintln(N);
 			return 1;
 		}
-// 		printf("%f  ", local_scores[it.set().bits]); it.set().rprintln(N);
 	}
 	
 	fclose(f);
@@ -214,10 +384,19 @@ void input_tree_file(const char **argv)
 		return;
 	}
 	
-	char buffer[1024];
-	
-	while (fgets(buffer, 1024, f)) {
-		*strchr(buffer, '\n') = '\0';
+	char buffer[4096];
+	
+	while (fgets(buffer, sizeof(buffer), f)) {
+		char *end = strchr(buffer, '\n');
+		if (end != NULL) {
+			*end = '\0';
+		} else if (!feof(f)) {
+			// skip the rest of a line that does not fit
+			int c;
+			while ((c = fgetc(f)) != EOF && c != '\n');
+			printf("Error: A tree is longer than %zu characters.\n", sizeof(buffer) - 2);
+			continue;
+		}
 		print_tree(buffer);
 	}
 	
@@ -230,6 +409,7 @@ void enumerate()
 	
 	Graph *G = new Graph(N);
 	G->local_scores = local_scores;
+	G->score_width = M;
 	G->enumerate_chordal(probs);
 	
 	for (unsigned i = 0; i < N-1; i++) {
@@ -243,6 +423,16 @@ void enumerate()
 }
 
 
+// Tables that are allocated as they are used can outgrow the memory in the
+// middle of a run. Reports it instead of aborting on std::bad_alloc.
+void out_of_memory()
+{
+	printf("\nError: Out of memory. Plan the run with --mem-limit, or keep the tables in scratch files with --scratch.\n");
+	fflush(stdout);
+	_exit(1);
+}
+
+
 #define END_USAGE { print_usage(cmd); return 0; }
 
 int main(int, const char **argv)
@@ -250,6 +440,15 @@ int main(int, const char **argv)
 	const char *cmd = *argv++;
 	if (!*argv) END_USAGE;
 	
+	select_logsumexp("exact");
+	std::set_new_handler(out_of_memory);
+	
+	while (!strncmp(*argv, "--", 2)) {
+		if (!read_option(*argv)) END_USAGE;
+		argv++;
+		if (!*argv) END_USAGE;
+	}
+	
 	const char *arg = *argv;
 	if (arg[0] == '-') {
 		if (!read_flags(arg + 1)) END_USAGE;
@@ -259,6 +458,9 @@ int main(int, const char **argv)
 		strcpy(output_flags, "ksthv");
 	}
 	
+	// the processes share the tables level by level
+	if (opt_procs > 1) opt_bottom_up = 1;
+	
 	const char *input_file = *argv++;
 	
 	vbprintf("Input score file: %s\n", input_file);
@@ -266,7 +468,13 @@ int main(int, const char **argv)
 	const char *max_width = NULL;
 	if (*argv && atoi(*argv)) max_width = *argv++;
 	
-	if (read_data(input_file, max_width)) return 0;
+	if (read_data(input_file, max_width, argv)) return 0;
+	
+	STAT_PHASE(PHASE_SEARCH);
+	
+	if (opt_subset_convolution && (!*argv || !strcmp(*argv, "max") || !strcmp(*argv, "kbest"))) {
+		printf("Warning: Subset convolution (-z) is only available for the sum and count tables, the max tables are filled by the exact sums.\n");
+	}
 	
 	if (!*argv || !strcmp(*argv, "max")) {
 		find_global_optimum();
@@ -278,10 +486,21 @@ int main(int, const char **argv)
 		input_tree_file(argv+1);
 	} else if (!strcmp(*argv, "enum")) {
 		enumerate();
+	} else if (!strcmp(*argv, "edges")) {
+		edge_marginals(argv+1);
+	} else if (!strcmp(*argv, "count")) {
+		count_trees();
+	} else if (!strcmp(*argv, "kbest")) {
+		kbest(argv+1);
+	} else if (!strcmp(*argv, "serve")) {
+		serve(argv+1);
+	} else if (!strcmp(*argv, "update")) {
+		update(argv+1);
 	} else {
 		printf("Error: Unknown action.\n");
 		print_usage(cmd);
 	}
 	
 	delete [] local_scores;
+	print_stats();
 }
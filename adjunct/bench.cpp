@@ -0,0 +1,322 @@
+/*
+ *  Adjunct
+ *  
+ *  Copyright 2015 Kustaa Kangas <jwkangas(at)cs.helsinki.fi>
+ *  
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *  
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *  
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <cstdio>
+#include <cstring>
+#include <chrono>
+#include <random>
+#include <vector>
+
+#include "common.hpp"
+#include "logsumexp.hpp"
+#include "discretedist.hpp"
+
+
+// Microbenchmarks of the primitives that the DP and the samplers spend their
+// time in. Each benchmark is repeated, doubling the repetitions, until it runs
+// for at least MIN_TIME seconds, and the time per operation is reported. The
+// results are written as tab-separated lines
+//
+//   label  benchmark  parameters  operations  seconds  ns/op
+//
+// where the label names the build (make bench uses the commit), so that the
+// files of several runs can be joined on the benchmark and its parameters.
+
+static const double MIN_TIME = 0.25;
+
+// results are added up here so that the compiler cannot drop the work
+volatile double sink;
+
+struct Bench
+{
+	FILE *out;
+	const char *label;
+	
+	Bench(FILE *out, const char *label) : out(out), label(label)
+	{
+		fprintf(out, "label\tbenchmark\tparameters\toperations\tseconds\tns/op\n");
+	}
+	
+	// body(reps) runs the operation reps times over its inputs and returns the
+	// number of operations done
+	template <typename Body>
+	void run(const char *name, const char *params, Body body)
+	{
+		typedef std::chrono::steady_clock Clock;
+		
+		body(1);
+		
+		double seconds = 0;
+		long long unsigned ops = 0;
+		for (long long unsigned reps = 1; seconds < MIN_TIME; reps *= 2) {
+			Clock::time_point start = Clock::now();
+			ops = body(reps);
+			seconds = std::chrono::duration<double>(Clock::now() - start).count();
+		}
+		
+		double ns = 1e9 * seconds / ops;
+		fprintf(out, "%s\t%s\t%s\t%llu\t%.6f\t%.3f\n", label, name, params, ops, seconds, ns);
+		printf("%-32s %-24s %12.3f ns/op\n", name, params, ns);
+		fflush(stdout);
+	}
+};
+
+
+void bench_iterators(Bench &b)
+{
+	const unsigned n = 20, k = 4;
+	Set V = Set::complete(n);
+	char params[64];
+	
+	sprintf(params, "n=%u", n);
+	b.run("range_iterator", params, [&](long long unsigned reps) {
+		long long unsigned ops = 0;
+		for (long long unsigned r = 0; r < reps; r++) {
+			set_word x = 0;
+			for (range_iterator<Set> it(n, Set::empty(n), V); it.has_next(); ++it) {
+				x ^= it.set().bits;
+				ops++;
+			}
+			sink = sink + x;
+		}
+		return ops;
+	});
+	
+	sprintf(params, "n=%u k=%u", n, k);
+	b.run("range_k_iterator", params, [&](long long unsigned reps) {
+		long long unsigned ops = 0;
+		for (long long unsigned r = 0; r < reps; r++) {
+			set_word x = 0;
+			for (range_k_iterator<Set> it(n, k, Set::empty(n), V); it.has_next(); ++it) {
+				x ^= it.set().bits;
+				ops++;
+			}
+			sink = sink + x;
+		}
+		return ops;
+	});
+}
+
+
+void bench_tables(Bench &b, std::mt19937 &gen)
+{
+	const unsigned n = 14, w = 3, pairs = 4096;
+	char params[64];
+	sprintf(params, "n=%u w=%u", n, w);
+	
+	DisjointPairArray<double> array(n, w, 0.0);
+	
+	// random entries (x,y) with |x| <= w and y disjoint from x
+	std::vector<set_word> xs, ys;
+	while (xs.size() < pairs) {
+		set_word x = gen() & Set::complete(n).bits, y = gen() & Set::complete(n).bits & ~x;
+		if (Set(x).cardinality(n) > w) continue;
+		xs.push_back(x);
+		ys.push_back(y);
+	}
+	
+	b.run("DisjointPairArray::index", params, [&](long long unsigned reps) {
+		long long unsigned sum = 0;
+		for (long long unsigned r = 0; r < reps; r++) {
+			for (unsigned i = 0; i < pairs; i++) sum += array.index(xs[i], ys[i]);
+		}
+		sink = sink + sum;
+		return reps * pairs;
+	});
+	
+	b.run("DisjointPairArray::set", params, [&](long long unsigned reps) {
+		for (long long unsigned r = 0; r < reps; r++) {
+			for (unsigned i = 0; i < pairs; i++) array.set(xs[i], ys[i], (double)(r + i));
+		}
+		return reps * pairs;
+	});
+	
+	b.run("DisjointPairArray::get", params, [&](long long unsigned reps) {
+		double sum = 0;
+		for (long long unsigned r = 0; r < reps; r++) {
+			for (unsigned i = 0; i < pairs; i++) sum += array.get(xs[i], ys[i]);
+		}
+		sink = sink + sum;
+		return reps * pairs;
+	});
+}
+
+
+void bench_logsum(Bench &b, std::mt19937 &gen)
+{
+	const unsigned n = 4096;
+	std::uniform_real_distribution<double> uniform(-50, 0);
+	std::vector<double> x(n);
+	for (unsigned i = 0; i < n; i++) x[i] = uniform(gen);
+	
+	b.run("logsum", "pairwise", [&](long long unsigned reps) {
+		for (long long unsigned r = 0; r < reps; r++) {
+			double sum = -INFTY;
+			for (unsigned i = 0; i < n; i++) sum = logsum(sum, x[i]);
+			sink = sink + sum;
+		}
+		return reps * n;
+	});
+	
+	const char *modes[] = { "exact", "fast", "scalar" };
+	for (unsigned m = 0; m < 3; m++) {
+		select_logsumexp(modes[m]);
+		char params[64];
+		sprintf(params, "blocked %s", logsumexp_name());
+		b.run("LogSumExp", params, [&](long long unsigned reps) {
+			for (long long unsigned r = 0; r < reps; r++) {
+				LogSumExp sum;
+				for (unsigned i = 0; i < n; i++) sum.add(x[i]);
+				sink = sink + sum.value();
+			}
+			return reps * n;
+		});
+	}
+	select_logsumexp("exact");
+}
+
+
+void bench_discrete_dist(Bench &b, std::mt19937 &gen)
+{
+	std::uniform_real_distribution<double> uniform(0, 1);
+	
+	const unsigned sizes[] = { 16, 4096 };
+	for (unsigned s = 0; s < 2; s++) {
+		unsigned n = sizes[s];
+		std::vector<double> probs(n);
+		double total = 0;
+		for (unsigned i = 0; i < n; i++) total += probs[i] = uniform(gen);
+		for (unsigned i = 0; i < n; i++) probs[i] /= total;
+		
+		char params[64];
+		sprintf(params, "n=%u", n);
+		
+		b.run("DiscreteDist::DiscreteDist", params, [&](long long unsigned reps) {
+			for (long long unsigned r = 0; r < reps; r++) {
+				DiscreteDist<double> dist(probs);
+				sink = sink + dist.rand();
+			}
+			return reps;
+		});
+		
+		DiscreteDist<double> dist(probs);
+		b.run("DiscreteDist::rand", params, [&](long long unsigned reps) {
+			long long unsigned sum = 0;
+			for (long long unsigned r = 0; r < reps; r++) sum += dist.rand();
+			sink = sink + sum;
+			return reps;
+		});
+	}
+}
+
+
+// A random junction tree of n variables with cliques of w variables: after
+// the first clique, each variable forms a clique with a separator of w-1
+// variables of a random earlier clique.
+TreeNode<Set> *random_tree(unsigned n, unsigned w, std::mt19937 &gen)
+{
+	Set C = Set::empty(n);
+	for (unsigned v = 0; v < w; v++) C = C | v;
+	
+	std::vector<TreeNode<Set>*> nodes;
+	nodes.push_back(new TreeNode<Set>(C, Set::empty(n)));
+	
+	for (unsigned v = w; v < n; v++) {
+		TreeNode<Set> *parent = nodes[gen() % nodes.size()];
+		int elements[MAX_SET_SIZE];
+		unsigned k = parent->C.get_list(n, elements);
+		Set S = parent->C ^ (unsigned)elements[gen() % k];
+		
+		TreeNode<Set> *child = new TreeNode<Set>(S | v, S);
+		parent->add(child);
+		nodes.push_back(child);
+	}
+	
+	return nodes[0];
+}
+
+void bench_trees(Bench &b, std::mt19937 &gen)
+{
+	const unsigned w = 3;
+	char params[64];
+	
+	N = 24;
+	sprintf(params, "n=%u w=%u", N, w);
+	TreeNode<Set> *root = random_tree(N, w, gen);
+	b.run("TreeNode::count_junction_trees", params, [&](long long unsigned reps) {
+		double sum = 0;
+		for (long long unsigned r = 0; r < reps; r++) sum += root->count_junction_trees();
+		sink = sink + sum;
+		return reps;
+	});
+	delete root;
+	
+	// scores of all sets of up to w variables, as read from a score file
+	N = 16;
+	sprintf(params, "n=%u w=%u", N, w);
+	std::uniform_real_distribution<double> uniform(-100, 0);
+	double *scores = new double[set_indices(N, w)];
+	for (range_k_iterator<Set> it(N, w, Set::empty(N), Set::complete(N)); it.has_next(); ++it) {
+		scores[set_index(it.set(), w)] = uniform(gen);
+	}
+	
+	root = random_tree(N, w, gen);
+	Graph *graph = root->graph();
+	graph->local_scores = scores;
+	graph->score_width = w;
+	b.run("Graph::get_score", params, [&](long long unsigned reps) {
+		double sum = 0;
+		int n_cliques;
+		for (long long unsigned r = 0; r < reps; r++) sum += graph->get_score(n_cliques);
+		sink = sink + sum;
+		return reps;
+	});
+	delete graph;
+	delete root;
+	delete [] scores;
+}
+
+
+int main(int argc, const char **argv)
+{
+	const char *file = argc > 1 ? argv[1] : "bench.tsv";
+	const char *label = argc > 2 ? argv[2] : "-";
+	
+	FILE *out = fopen(file, "w");
+	if (out == NULL) {
+		printf("Error: Could not write: %s\n", file);
+		return 1;
+	}
+	
+	select_logsumexp("exact");
+	range_k_iterator<Set>::init(MAX_SET_SIZE);
+	rng.seed(1);
+	std::mt19937 gen(1);
+	
+	Bench b(out, label);
+	bench_iterators(b);
+	bench_tables(b, gen);
+	bench_logsum(b, gen);
+	bench_discrete_dist(b, gen);
+	bench_trees(b, gen);
+	
+	fclose(out);
+	printf("Results written to %s\n", file);
+	return 0;
+}
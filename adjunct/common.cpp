@@ -19,9 +19,14 @@
 
 #include <cstdlib>
 #include <cmath>
+#include <cfloat>
+#include <cerrno>
+#include <algorithm>
 // #include <sys/time.h>
 
 #include "common.hpp"
+#include "tablefile.hpp"
+#include "stats.hpp"
 
 Rng rng;
 
@@ -34,9 +39,21 @@ int opt_output_headers = 1;
 int opt_output_edge_estimates = 0;
 int opt_naive_sampling = 0;
 int opt_output_sample_times = 0;
+int opt_bottom_up = 0;
+unsigned opt_threads = 1;
+unsigned opt_procs = 1;
+int opt_subset_convolution = 0;
+int opt_branch_and_bound = 0;
+const char *opt_incumbent = NULL;
+int opt_argmax = 0;
+int opt_single_precision = 0;
+const char *opt_scratch_directory = NULL;
+const char *opt_save_tables = NULL;
+const char *opt_load_tables = NULL;
+unsigned long long opt_memory_limit = 0;
 
 // number of vertices, maximum width (clique size)
-unsigned N, W;
+unsigned N, W, M;
 
 // table of local components for each vertex subset
 double *local_scores;
@@ -47,10 +64,43 @@ SetArray *f_values, *g_values, *h_values;
 
 
 
-void allocate_tables()
+// resources used when the tables were allocated
+Usage table_usage;
+
+// Tables are mapped to scratch files if a directory is given. Otherwise,
+// top-down only the rows of the entries that are reached are allocated.
+RowAllocation table_allocation()
+{
+	// scratch files are shared with forked processes as well
+	if (opt_scratch_directory != NULL) return ALLOCATE_MAPPED;
+	if (opt_procs > 1) return ALLOCATE_SHARED;
+	return opt_bottom_up ? ALLOCATE_ALL : ALLOCATE_LAZY;
+}
+
+// allocates the tables f, g and h of the given semiring, or maps them from a file
+void allocate_tables(const char *semiring, SetArray *&f, SetArray *&g, SetArray *&h)
 {
-	double required_memory = (double)SetArray::estimate(N, W) * 24 / 1024 / 1024;
-	vbprintf("Estimated memory requirement: ");
+	STAT_PHASE(PHASE_ALLOCATE);
+	RowAllocation allocation = table_allocation();
+	table_usage = Usage::now();
+	
+	if (opt_load_tables != NULL) {
+		unsigned size;
+		char *p = (char*)load_tables(opt_load_tables, semiring, size);
+		opt_single_precision = size == sizeof(float);
+		
+		long long unsigned bytes = SetArray::estimate(N, W) * size;
+		f = new SetArray(N, W, -INFTY, p, opt_single_precision);
+		g = new SetArray(N, W, -INFTY, p + bytes, opt_single_precision);
+		h = new SetArray(N, W, -INFTY, p + 2 * bytes, opt_single_precision);
+		return;
+	}
+	
+	unsigned bytes = opt_single_precision ? 3 * sizeof(float) : 3 * sizeof(double);
+	double required_memory = (double)SetArray::estimate(N, W) * bytes / 1024 / 1024;
+	vbprintf("Estimated memory requirement%s: ", allocation == ALLOCATE_LAZY ? " (at most)" :
+		allocation == ALLOCATE_MAPPED ? " (mapped to scratch files)" :
+		allocation == ALLOCATE_SHARED ? " (in shared memory)" : "");
 	if (required_memory < 1000) {
 		vbprintf("%.2f M\n", required_memory);
 	} else {
@@ -58,24 +108,60 @@ void allocate_tables()
 	}
 	vbprintf("Allocating DP tables f...");
 	fflush(stdout);
-	f_values = new SetArray(N, W, -INFTY);
+	f = new SetArray(N, W, -INFTY, allocation, opt_single_precision, opt_scratch_directory);
 	
 	vbprintf(" g...");
 	fflush(stdout);
-	g_values = new SetArray(N, W, -INFTY);
+	g = new SetArray(N, W, -INFTY, allocation, opt_single_precision, opt_scratch_directory);
 	
 	vbprintf(" h...");
 	fflush(stdout);
-	h_values = new SetArray(N, W, -INFTY);
+	h = new SetArray(N, W, -INFTY, allocation, opt_single_precision, opt_scratch_directory);
 }
 
-void deallocate_tables()
+void deallocate_tables(SetArray *f, SetArray *g, SetArray *h)
 {
+	vbprintf("Table values allocated: %llu of %llu\n", f->allocated() +
+		g->allocated() + h->allocated(), 3 * SetArray::estimate(N, W));
+	if (opt_verbose && opt_scratch_directory != NULL) Usage::now().print_since(table_usage);
 	vbprintf("Deallocating tables...\n");
 	
-	delete f_values;
-	delete g_values;
-	delete h_values;
+	STAT_PHASE(PHASE_FREE);
+	STAT_TABLE(STAT_F, f, -INFTY, SetArray::estimate(N, W));
+	STAT_TABLE(STAT_G, g, -INFTY, SetArray::estimate(N, W));
+	STAT_TABLE(STAT_H, h, -INFTY, SetArray::estimate(N, W));
+	
+	delete f;
+	delete g;
+	delete h;
+	unload_tables();
+}
+
+// the tables of the global arrays
+void allocate_tables(const char *semiring)
+{
+	allocate_tables(semiring, f_values, g_values, h_values);
+}
+
+void deallocate_tables()
+{
+	deallocate_tables(f_values, g_values, h_values);
+}
+
+// Returns a bound on the error of any max or sum table entry caused by storing
+// the tables in single precision. Both max and log-sum-exp change by at most
+// the largest change of their arguments, and the terms add up the errors of
+// the entries they depend on. So the error of an entry is at most the sum of
+// the rounding errors of the entries in one of its derivations, which has at
+// most 3N stored entries: f for each node of an RPT, and h and g for each
+// node except the root. Each is rounded by at most FLT_EPSILON / 2 relative
+// to its magnitude.
+double single_precision_error()
+{
+	if (!opt_single_precision) return 0;
+	
+	double max = std::max(f_values->max_magnitude(), std::max(g_values->max_magnitude(), h_values->max_magnitude()));
+	return 3 * N * (FLT_EPSILON / 2) * max;
 }
 
 // double get_time()
@@ -92,7 +178,14 @@ void deallocate_tables()
 
 TreeNode<Set> *parse_tree(const char *&s, Set parent)
 {
-	Set C = Set(atoi(s));
+	errno = 0;
+	long long unsigned bits = strtoull(s, NULL, 10);
+	
+	// cliques must be sets of the variables that have scores, checked before
+	// the bits are cut to the width of a set
+	if (errno == ERANGE || (N < 64 && bits >> N)) return NULL;
+	Set C = Set(bits);
+	if (C.cardinality(N) > M) return NULL;
 	
 	TreeNode<Set> *node = new TreeNode<Set>(C, C & parent);
 	
@@ -30,9 +30,109 @@ typedef std::mt19937 Rng;
 extern Rng rng;
 
 typedef uintset Set;
-typedef DisjointPairArray<double> SetArray;
 
-extern unsigned N, W;
+
+// A DisjointPairArray of scores stored either as doubles or as floats, which
+// halves the memory. The values are always read and written as doubles, so
+// only the stored values are rounded.
+struct ScoreArray
+{
+	DisjointPairArray<double> *doubles;
+	DisjointPairArray<float> *floats;
+	
+	static long long unsigned estimate(unsigned n, unsigned w)
+	{
+		return DisjointPairArray<double>::estimate(n, w);
+	}
+	
+	ScoreArray(unsigned n, unsigned w, double initial, RowAllocation allocation = ALLOCATE_ALL,
+		bool single = false, const char *directory = NULL) : doubles(NULL), floats(NULL)
+	{
+		if (single) floats = new DisjointPairArray<float>(n, w, initial, allocation, directory);
+		else doubles = new DisjointPairArray<double>(n, w, initial, allocation, directory);
+	}
+	
+	// uses rows stored elsewhere (see DisjointPairArray)
+	ScoreArray(unsigned n, unsigned w, double initial, void *rows, bool single) : doubles(NULL), floats(NULL)
+	{
+		if (single) floats = new DisjointPairArray<float>(n, w, initial, (float*)rows);
+		else doubles = new DisjointPairArray<double>(n, w, initial, (double*)rows);
+	}
+	
+	~ScoreArray()
+	{
+		delete doubles;
+		delete floats;
+	}
+	
+	long long unsigned index(set_word x, set_word y)
+	{
+		return doubles ? doubles->index(x, y) : floats->index(x, y);
+	}
+	
+	double get(set_word x, set_word y)
+	{
+		return doubles ? doubles->get(x, y) : floats->get(x, y);
+	}
+	
+	void set(set_word x, set_word y, double value)
+	{
+		if (doubles) doubles->set(x, y, value);
+		else floats->set(x, y, value);
+	}
+	
+	double get_short(set_word x, long long unsigned u)
+	{
+		return doubles ? doubles->get_short(x, u) : floats->get_short(x, u);
+	}
+	
+	void set_short(set_word x, long long unsigned u, double value)
+	{
+		if (doubles) doubles->set_short(x, u, value);
+		else floats->set_short(x, u, value);
+	}
+	
+	long long unsigned allocated()
+	{
+		return doubles ? doubles->allocated() : floats->allocated();
+	}
+	
+	long long unsigned filled(double initial)
+	{
+		return doubles ? doubles->filled(initial) : floats->filled(initial);
+	}
+	
+	// returns the largest finite magnitude of the values in the allocated rows
+	template <typename T>
+	static double max_magnitude(DisjointPairArray<T> *array)
+	{
+		double max = 0;
+		unsigned n = array->n;
+		for (range_k_iterator<uintset> it(n, array->w, uintset::empty(n), uintset::complete(n)); it.has_next(); ++it) {
+			T *p = array->allocated_row(it.set().bits);
+			if (p == NULL) continue;
+			long long unsigned size = array->size(it.set().bits);
+			for (long long unsigned u = 0; u < size; u++) {
+				double v = fabs(p[u]);
+				if (v != INFTY && v > max) max = v;
+			}
+		}
+		return max;
+	}
+	
+	double max_magnitude()
+	{
+		return doubles ? max_magnitude(doubles) : max_magnitude(floats);
+	}
+};
+
+typedef ScoreArray SetArray;
+
+// exact counts of RPTs
+__extension__ typedef unsigned __int128 count_t;
+#define count_overflow (~(count_t)0)
+
+extern unsigned N, W, M;
 extern double *local_scores;
 extern SetArray *f_values, *g_values, *h_values;
 
@@ -42,40 +142,36 @@ extern int opt_output_headers;
 extern int opt_output_edge_estimates;
 extern int opt_naive_sampling;
 extern int opt_output_sample_times;
+extern int opt_bottom_up;
+extern unsigned opt_threads;
+extern unsigned opt_procs;
+extern int opt_subset_convolution;
+extern int opt_branch_and_bound;
+extern const char *opt_incumbent;
+extern int opt_argmax;
+extern int opt_single_precision;
+extern const char *opt_scratch_directory;
+extern const char *opt_save_tables;
+extern const char *opt_load_tables;
+extern unsigned long long opt_memory_limit;
 
 
 #define vbprintf(...) if (opt_verbose) fprintf (stdout, __VA_ARGS__)
-#define local_score(X) (local_scores[X.bits])
+// the scores of the sets of size at most M, by set_index
+#define local_score(X) (local_scores[set_index(X, M)])
 
-void allocate_tables();
+RowAllocation table_allocation();
+void allocate_tables(const char *semiring, SetArray *&f, SetArray *&g, SetArray *&h);
+void deallocate_tables(SetArray *f, SetArray *g, SetArray *h);
+void allocate_tables(const char *semiring);
 void deallocate_tables();
+double single_precision_error();
+int plan_memory(const char **action);
+int check_memory(const char **action);
 
 // double get_time();
 
 
-#define H_ITERATE(it) \
-for (range_iterator<Set> it(N, Set::empty(N), C, 1, 0); it.has_next(); ++it)
-
-#define G_ITERATE(it) \
-unsigned f = U.first(N); \
-for (range_iterator<Set> it(N, Set::empty(N) | f, U); it.has_next(); ++it)
-
-#define F_ITERATE(it) \
-unsigned card_S = S.cardinality(N); \
-assert((int)W - (int)card_S > 0); \
-for (range_k_iterator<Set> it(N, W - card_S, Set::empty(N), R, 0); it.has_next(); ++it) 
-
-// In maximation only, if the separator S is empty, then we can always
-// put the lexicografically least element of R into C.
-// This is still guaranteed to consider at least one optimal solution.
-#define F_ITERATE_OPT(it) \
-unsigned card_S = S.cardinality(N); \
-assert((int)W - (int)card_S > 0); \
-Set from = card_S == 0 ? Set::empty(N) | R.first(N) : Set::empty(N); \
-int start = card_S == 0 ? 1 : 0; \
-for (range_k_iterator<Set> it(N, W - card_S, from, R, start); it.has_next(); ++it)
-
-
 template <typename Set>
 struct TreeNode
 {
@@ -108,7 +204,7 @@ struct TreeNode
 	
 	void print(int d, int w, int level, int *bars)
 	{
-		char buffer[128] = "";
+		char buffer[512] = "";
 		
 		for (int i = 0; i < level; i++) {
 			if (i == level - 1) {
@@ -148,6 +244,18 @@ struct TreeNode
 		return w;
 	}
 	
+	// returns the union of the cliques of the tree
+	Set variables()
+	{
+		Set X = C;
+		
+		for (unsigned i = 0; i < children.size(); i++) {
+			X |= children[i]->variables();
+		}
+		
+		return X;
+	}
+	
 	// returns the depth of the tree
 	int depth()
 	{
@@ -321,7 +429,7 @@ struct TreeNode
 	
 	void serialize_ref(char *&s)
 	{
-		sprintf(s, "%i", C.bits);
+		sprintf(s, "%llu", (long long unsigned)C.bits);
 		s = strchr(s, '\0');
 		for (unsigned i = 0; i < children.size(); i++) {
 			*s++ = '{';
@@ -354,7 +462,7 @@ struct TreeNode
 				printf("%f\n", score());
 			} else if (*p == 'c') {
 				header("Compact");
-				char s[1024];
+				char s[2048];
 				serialize(s);
 				printf("%s\n", s);
 			} else if (*p == 'j') {
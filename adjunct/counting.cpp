@@ -0,0 +1,100 @@
+/*
+ *  Adjunct
+ *  
+ *  Copyright 2015 Kustaa Kangas <jwkangas(at)cs.helsinki.fi>
+ *  
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *  
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *  
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "kernel.hpp"
+
+
+// writes the decimal representation of x into str
+void count_to_string(count_t x, char *str)
+{
+	char buffer[64];
+	int n = 0;
+	
+	do {
+		buffer[n++] = '0' + (int)(x % 10);
+		x /= 10;
+	} while (x > 0);
+	
+	while (n > 0) *str++ = buffer[--n];
+	*str = '\0';
+}
+
+
+// counts the RPTs of maximum width W over all N vertices
+void count_trees()
+{
+	typedef CountTables::Array CountArray;
+	
+	STAT_PHASE(PHASE_ALLOCATE);
+	RowAllocation allocation = table_allocation();
+	const char *dir = opt_scratch_directory;
+	Usage start = Usage::now();
+	
+	double required_memory = (double)CountArray::estimate(N, W) * 3 * sizeof(count_t) / 1024 / 1024;
+	vbprintf("Estimated memory requirement%s: ", allocation == ALLOCATE_LAZY ? " (at most)" : "");
+	if (required_memory < 1000) {
+		vbprintf("%.2f M\n", required_memory);
+	} else {
+		vbprintf("%.2f G\n", required_memory / 1024);
+	}
+	vbprintf("Allocating count tables...\n");
+	
+	CountTables tables(NULL, NULL, NULL);
+	if (opt_load_tables != NULL) {
+		unsigned size;
+		count_t *p = (count_t*)load_tables(opt_load_tables, CountSemiring::name(), size);
+		if (size != sizeof(count_t)) {
+			printf("Error: %s has counts of another size.\n", opt_load_tables);
+			exit(1);
+		}
+		long long unsigned values = CountArray::estimate(N, W);
+		tables.f_values = new CountArray(N, W, 0, p);
+		tables.g_values = new CountArray(N, W, 0, p + values);
+		tables.h_values = new CountArray(N, W, 0, p + 2 * values);
+	} else {
+		tables.f_values = new CountArray(N, W, 0, allocation, dir);
+		tables.g_values = new CountArray(N, W, 0, allocation, dir);
+		tables.h_values = new CountArray(N, W, 0, allocation, dir);
+	}
+	
+	vbprintf("\nCounting RPTs...\n");
+	count_t count = compute_tables(tables);
+	
+	STAT_PHASE(PHASE_OUTPUT);
+	if (opt_output_headers) printf("====================================== RPTs\n");
+	
+	if (count == count_overflow) {
+		printf("overflow (at least 2^128-1)\n");
+	} else {
+		char str[64];
+		count_to_string(count, str);
+		printf("%s\n", str);
+	}
+	
+	if (opt_verbose && dir != NULL) Usage::now().print_since(start);
+	
+	STAT_PHASE(PHASE_FREE);
+	STAT_TABLE(STAT_F, tables.f_values, (count_t)0, CountArray::estimate(N, W));
+	STAT_TABLE(STAT_G, tables.g_values, (count_t)0, CountArray::estimate(N, W));
+	STAT_TABLE(STAT_H, tables.h_values, (count_t)0, CountArray::estimate(N, W));
+	delete tables.f_values;
+	delete tables.g_values;
+	delete tables.h_values;
+	unload_tables();
+}
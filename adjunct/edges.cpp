@@ -0,0 +1,185 @@
+/*
+ *  Adjunct
+ *  
+ *  Copyright 2015 Kustaa Kangas <jwkangas(at)cs.helsinki.fi>
+ *  
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *  
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *  
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <cmath>
+#include <vector>
+
+#include "kernel.hpp"
+
+
+// Exact edge marginals by an outside pass over the sum tables. The sum tables
+// add up the weights of all RPTs, so they define a distribution over RPTs. In
+// a junction tree, the cliques that contain both u and v form a subtree, whose
+// edges are exactly the separators that contain both. Thus the graph of an RPT
+// has the edge uv iff the number of its cliques containing uv minus the number
+// of its separators containing uv is 1 (and otherwise it is 0), and
+//
+//   P_RPT(uv) = E[#cliques containing uv] - E[#separators containing uv],
+//
+// where the expectations over the RPTs are sums of the probabilities that an
+// RPT has a node with the clique C and the separator S. These come from the
+// expected numbers of times the entries are used: f(Ø,V) is used once, and a
+// term of an entry used b times is used b times the term over the entry, as
+// are the entries in the term. The term D of f(S,R) is the node (S u D, S).
+// Since every term is divided by its entry, this takes one exponential per
+// term, like the sums themselves, and no logarithms.
+//
+// The correction: this is the posterior of the edges when each graph G is
+// weighted by its number of RPTs #RPT(G), i.e., the edges of the graph of a
+// random RPT. The posterior of the graphs themselves weights each graph by
+// 1 / #RPT(G) relative to it,
+//
+//   P(uv) = E[[uv in G] / #RPT(G)] / E[1 / #RPT(G)],
+//
+// which does not factor over the nodes. It is what sample -e estimates (and
+// enum computes by brute force). The two differ the more the graphs with an
+// edge differ in their number of RPTs from those without it.
+
+typedef Recurrence<SumSemiring> Sum;
+
+
+// adds to the expected number of uses of an entry
+void add_uses(SetArray &b, Set X, Set Y, double uses)
+{
+	b.set(X.bits, Y.bits, b.get(X.bits, Y.bits) + uses);
+}
+
+// Computes, for each set X of size at most W (by set_index), the expected
+// number of nodes of an RPT with the clique X minus the expected number of
+// nodes with the separator X, visiting the entries from f(Ø,V) down, in the
+// reverse of the bottom-up order: on each level g, then h, then f.
+template <typename Tables>
+void outside_pass(Tables &t, std::vector<double> &nodes)
+{
+	RowAllocation allocation = table_allocation();
+	const char *dir = opt_scratch_directory;
+	SetArray bf(N, W, 0.0, allocation, false, dir);
+	SetArray bg(N, W, 0.0, allocation, false, dir);
+	SetArray bh(N, W, 0.0, allocation, false, dir);
+	
+	Set V = Set::complete(N);
+	bf.set(Set::empty(N).bits, V.bits, 1.0);
+	
+	nodes.assign(set_indices(N, W), 0.0);
+	
+	for (unsigned k = N; k >= 1; k--) {
+		for (range_k_iterator<Set> ct(N, W, Set::empty(N), V); ct.has_next(); ++ct) {
+			Set C = ct.set();
+			if (C.is_empty()) continue;
+			for (range_exact_iterator<Set> ut(N, k, Set::empty(N), V ^ C); ut.has_next(); ++ut) {
+				Set U = ut.set();
+				double b = bg.get(C.bits, U.bits);
+				if (b == 0) continue;
+				
+				double g = t.g(C, U);
+				for (g_iterator it(U); it.has_next(); ++it) {
+					Set R = it.set();
+					double uses = b * exp(Sum::g_term(t, C, U, R) - g);
+					add_uses(bh, C, R, uses);
+					if (R != U) add_uses(bg, C, U ^ R, uses);
+				}
+			}
+		}
+		
+		for (range_k_iterator<Set> ct(N, W, Set::empty(N), V); ct.has_next(); ++ct) {
+			Set C = ct.set();
+			if (C.is_empty()) continue;
+			for (range_exact_iterator<Set> rt(N, k, Set::empty(N), V ^ C); rt.has_next(); ++rt) {
+				Set R = rt.set();
+				double b = bh.get(C.bits, R.bits);
+				if (b == 0) continue;
+				
+				double h = t.h(C, R);
+				for (h_iterator it(C); it.has_next(); ++it) {
+					Set S = it.set();
+					add_uses(bf, S, R, b * exp(Sum::h_term(t, S, R) - h));
+				}
+			}
+		}
+		
+		for (range_k_iterator<Set> st(N, W - 1, Set::empty(N), V); st.has_next(); ++st) {
+			Set S = st.set();
+			for (range_exact_iterator<Set> rt(N, k, Set::empty(N), V ^ S); rt.has_next(); ++rt) {
+				Set R = rt.set();
+				double b = bf.get(S.bits, R.bits);
+				if (b == 0) continue;
+				
+				double f = t.f(S, R);
+				for (f_iterator it(S, R, SumSemiring::fix_first); it.has_next(); ++it) {
+					Set D = it.set();
+					Set C = S | D;
+					double uses = b * exp(Sum::f_term(t, S, R, D) - f);
+					nodes[set_index(C, W)] += uses;
+					nodes[set_index(S, W)] -= uses;
+					if (D != R) add_uses(bg, C, R ^ D, uses);
+				}
+			}
+		}
+	}
+}
+
+// computes P_RPT(uv) into probs[u*N+v] for all u < v
+template <typename Tables>
+void edge_probabilities(Tables &t, double *probs)
+{
+	std::vector<double> nodes;
+	outside_pass(t, nodes);
+	
+	for (unsigned i = 0; i < N * N; i++) probs[i] = 0;
+	
+	for (range_k_iterator<Set> it(N, W, Set::empty(N), Set::complete(N)); it.has_next(); ++it) {
+		Set X = it.set();
+		double x = nodes[set_index(X, W)];
+		if (x == 0) continue;
+		
+		int elements[MAX_SET_SIZE];
+		int k = X.get_list(N, elements);
+		for (int a = 0; a < k-1; a++) {
+			for (int b = a+1; b < k; b++) probs[elements[a]*N + elements[b]] += x;
+		}
+	}
+}
+
+template void edge_probabilities(FilledSumTables &t, double *probs);
+
+
+void edge_marginals(const char **)
+{
+	allocate_tables(SumSemiring::name());
+	
+	SumTables tables(f_values, g_values, h_values);
+	
+	vbprintf("\nComputing sum tables (log-sum-exp: %s)...\n", logsumexp_name());
+	double sum_score = compute_tables(tables);
+	vbprintf("Total score: %f\n", sum_score);
+	
+	vbprintf("Computing edge marginals over RPTs by an outside pass...\n");
+	double probs[MAX_SET_SIZE * MAX_SET_SIZE];
+	edge_probabilities(tables, probs);
+	
+	if (opt_output_headers) printf("====================================== Edge probabilities (RPTs)\n");
+	for (unsigned i = 0; i < N-1; i++) {
+		for (unsigned j = i+1; j < N; j++) {
+			printf("%i-%i  %f\n", i, j, probs[i*N+j]);
+		}
+	}
+	
+	deallocate_tables();
+}
@@ -68,10 +68,10 @@ struct list
 		printf("\n");
 	}
 	
-	unsigned get_int()
+	set_word get_int()
 	{
-		unsigned s = 0;
-		for (int i = 0; i < n; i++) s += 1 << item(i);
+		set_word s = 0;
+		for (int i = 0; i < n; i++) s += (set_word)1 << item(i);
 		return s;
 	}
 };
@@ -83,6 +83,7 @@ struct Graph
 	bool edges[MAX_SET_SIZE][MAX_SET_SIZE];
 	int n;
 	double *local_scores;
+	unsigned score_width;	// the maximum size of the sets in local_scores, by set_index
 	double edge_p[MAX_SET_SIZE][MAX_SET_SIZE];
 	int n_chordal;
 	double score_total;
@@ -226,7 +227,13 @@ struct Graph
 		fprintf(f, "}\n");
 	}
 	
-	// determines the cliques and separators and computes the total score
+	double local_score(list *set)
+	{
+		return local_scores[set_index(uintset(set->get_int()), score_width)];
+	}
+	
+	// determines the cliques and separators and computes the total score,
+	// DBL_MAX if the graph is not chordal or has a clique without a score
 	double get_score(int &n_cliques)
 	{
 		double score = 0.0;
@@ -243,14 +250,18 @@ struct Graph
 			
 			if (has_common_neighbor(potential, subset)) {
 // 				printf("S: "); potential->print();
-				score -= local_scores[potential->get_int()];
+				score -= local_score(potential);
 			}
 			
 			potential->add(s);
+			if ((unsigned)potential->n > score_width) {
+				delete potential;
+				return DBL_MAX;
+			}
 			
 			if (!has_common_neighbor(potential)) {
 // 				printf("C: "); potential->print();
-				score += local_scores[potential->get_int()];
+				score += local_score(potential);
 				n_cliques++;
 			}
 			
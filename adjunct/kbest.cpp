@@ -0,0 +1,280 @@
+/*
+ *  Adjunct
+ *  
+ *  Copyright 2015 Kustaa Kangas <jwkangas(at)cs.helsinki.fi>
+ *  
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *  
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *  
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <climits>
+#include <set>
+#include <tuple>
+#include <unordered_map>
+
+#include "kernel.hpp"
+
+
+// Lazy k-best enumeration of RPTs (Huang & Chiang 2005, algorithm 3) over the
+// max recurrences. Each entry of f, g and h is a node whose incoming edges are
+// the terms of its sum, and the RPTs are exactly the derivations of f(Ø,V).
+// The k-th best derivation of an entry combines an edge with derivations of
+// given ranks of the entries it depends on (at most two, for g). The 1-best
+// values are read from the max tables; the candidate heaps and the lists of
+// best derivations are built only for the entries that the enumeration
+// reaches, and each entry is extended only one rank at a time.
+//
+// Many RPTs represent the same junction tree, and many junction trees the same
+// graph, so the RPTs are enumerated in order of score until k distinct graphs
+// (or junction trees) have been found. For graphs, the terms of f(Ø,R) are
+// restricted to sets D containing the first element of R as in max, which
+// leaves out some junction trees but no graphs. For junction trees, all terms
+// are enumerated; the 1-best values in the tables are the same either way.
+struct KBest
+{
+	enum { F = 0, G, H };
+	
+	// a term of an entry, given by its set D, R or S, with the ranks of the
+	// derivations of the entries it depends on
+	struct Derivation
+	{
+		double score;
+		Set arg;
+		unsigned rank[2];
+		
+		bool operator<(const Derivation &d) const
+		{
+			return score < d.score;
+		}
+	};
+	
+	// an entry on which the terms depend; g(C,Ø) is not an entry
+	struct Tail
+	{
+		unsigned char table;
+		Set X, Y;
+	};
+	
+	struct Entry
+	{
+		std::vector<Derivation> best;
+		std::vector<Derivation> candidates;
+		std::set<std::tuple<set_word, unsigned, unsigned> > seen;
+	};
+	
+	MaxTables &tables;
+	bool fix_first;
+	// the entries by their sets X and Y
+	typedef std::pair<set_word, set_word> Key;
+	struct KeyHash
+	{
+		size_t operator()(const Key &k) const
+		{
+			return std::hash<set_word>()(k.first) * 1099511628211ull ^ std::hash<set_word>()(k.second);
+		}
+	};
+	std::unordered_map<Key, Entry, KeyHash> entries[3];
+	
+	KBest(MaxTables &tables, bool fix_first) : tables(tables), fix_first(fix_first) {}
+	
+	static Key key(Set X, Set Y)
+	{
+		return Key(X.bits, Y.bits);
+	}
+	
+	// the weight of a term and the entries it depends on, returns their number
+	static unsigned tails(unsigned char table, Set X, Set Y, Set arg, double &weight, Tail *t)
+	{
+		unsigned n = 0;
+		if (table == F) {
+			Set C = X | arg;
+			weight = local_score(C);
+			if (!(Y ^ arg).is_empty()) t[n++] = { G, C, Y ^ arg };
+		} else if (table == G) {
+			weight = 0;
+			t[n++] = { H, X, arg };
+			if (!(Y ^ arg).is_empty()) t[n++] = { G, X, Y ^ arg };
+		} else {
+			weight = -local_score(arg);
+			t[n++] = { F, arg, Y };
+		}
+		return n;
+	}
+	
+	// the score of the derivation of given rank of an entry, which exists
+	double score(const Tail &t, unsigned rank)
+	{
+		if (rank == 0) {
+			if (t.table == F) return tables.f(t.X, t.Y);
+			if (t.table == G) return tables.g(t.X, t.Y);
+			return tables.h(t.X, t.Y);
+		}
+		return entries[t.table][key(t.X, t.Y)].best[rank].score;
+	}
+	
+	// adds the candidate for a term with given ranks unless it has been added
+	void push(Entry &e, unsigned char table, Set X, Set Y, Set arg, unsigned *rank)
+	{
+		if (!e.seen.insert(std::make_tuple(arg.bits, rank[0], rank[1])).second) return;
+		
+		Tail t[2];
+		Derivation d = { 0, arg, { rank[0], rank[1] } };
+		unsigned n = tails(table, X, Y, arg, d.score, t);
+		for (unsigned i = 0; i < n; i++) d.score += score(t[i], rank[i]);
+		
+		e.candidates.push_back(d);
+		std::push_heap(e.candidates.begin(), e.candidates.end());
+	}
+	
+	// makes sure that an entry has a derivation of given rank, returns false if
+	// it has fewer derivations
+	bool find(unsigned char table, Set X, Set Y, unsigned rank)
+	{
+		Entry &e = entries[table][key(X, Y)];
+		
+		if (e.best.empty() && e.candidates.empty()) {
+			unsigned rank[2] = { 0, 0 };
+			if (table == F) {
+				for (f_iterator it(X, Y, fix_first); it.has_next(); ++it) push(e, F, X, Y, it.set(), rank);
+			} else if (table == G) {
+				for (g_iterator it(Y); it.has_next(); ++it) push(e, G, X, Y, it.set(), rank);
+			} else {
+				for (h_iterator it(X); it.has_next(); ++it) push(e, H, X, Y, it.set(), rank);
+			}
+		}
+		
+		while (e.best.size() <= rank) {
+			// the successors of the last derivation become candidates before the next one is taken
+			if (!e.best.empty()) {
+				Derivation last = e.best.back();
+				Tail t[2];
+				double weight;
+				unsigned n = tails(table, X, Y, last.arg, weight, t);
+				for (unsigned i = 0; i < n; i++) {
+					unsigned next[2] = { last.rank[0], last.rank[1] };
+					next[i]++;
+					if (find(t[i].table, t[i].X, t[i].Y, next[i])) push(e, table, X, Y, last.arg, next);
+				}
+			}
+			
+			if (e.candidates.empty() || e.candidates.front().score == -INFTY) return false;
+			std::pop_heap(e.candidates.begin(), e.candidates.end());
+			e.best.push_back(e.candidates.back());
+			e.candidates.pop_back();
+		}
+		
+		return true;
+	}
+	
+	// builds the RPT of the derivation of given rank of an entry under node
+	TreeNode<Set> *build(unsigned char table, Set X, Set Y, unsigned rank, TreeNode<Set> *node)
+	{
+		find(table, X, Y, rank);
+		Derivation d = entries[table][key(X, Y)].best[rank];
+		
+		Tail t[2];
+		double weight;
+		unsigned n = tails(table, X, Y, d.arg, weight, t);
+		
+		if (table == F) {
+			TreeNode<Set> *child = new TreeNode<Set>(X | d.arg, X);
+			if (node != NULL) node->add(child);
+			if (n > 0) build(t[0].table, t[0].X, t[0].Y, d.rank[0], child);
+			return child;
+		}
+		
+		for (unsigned i = 0; i < n; i++) build(t[i].table, t[i].X, t[i].Y, d.rank[i], node);
+		return node;
+	}
+	
+	unsigned long long reached()
+	{
+		return entries[F].size() + entries[G].size() + entries[H].size();
+	}
+};
+
+
+// Collects the cliques of a tree, as pairs (C,Ø), and if edges is set, the
+// pairs of adjacent cliques in increasing order, which are never empty.
+void tree_key(TreeNode<Set> *node, bool edges, std::vector<KBest::Key> &key)
+{
+	key.push_back(KBest::Key(node->C.bits, 0));
+	for (unsigned i = 0; i < node->children.size(); i++) {
+		TreeNode<Set> *child = node->children[i];
+		if (edges) {
+			set_word a = std::min(node->C.bits, child->C.bits);
+			set_word b = std::max(node->C.bits, child->C.bits);
+			key.push_back(KBest::Key(a, b));
+		}
+		tree_key(child, edges, key);
+	}
+}
+
+
+// args are [<k> [graphs|trees]]
+void kbest(const char **argv)
+{
+	unsigned k = 1;
+	bool trees = false;
+	
+	if (*argv) {
+		char *end;
+		long n = strtol(*argv, &end, 10);
+		if (*end != '\0' || n < 1 || n > UINT_MAX) {
+			printf("Error: The number of best graphs or trees must be a positive integer: %s\n", *argv);
+			return;
+		}
+		k = n;
+		argv++;
+	}
+	if (*argv) {
+		if (!strcmp(*argv, "trees")) {
+			trees = true;
+		} else if (strcmp(*argv, "graphs")) {
+			printf("Error: Unknown kbest mode (graphs or trees): %s\n", *argv);
+			return;
+		}
+	}
+	
+	allocate_tables(MaxSemiring::name());
+	
+	MaxTables tables(f_values, g_values, h_values);
+	
+	vbprintf("\nComputing max tables...\n");
+	double max_score = compute_tables(tables);
+	vbprintf("Optimum: %f\n", max_score);
+	
+	vbprintf("Enumerating the %u best %s...\n", k, trees ? "junction trees" : "graphs");
+	
+	KBest kb(tables, !trees);
+	std::set<std::vector<KBest::Key> > found;
+	Set V = Set::complete(N);
+	
+	unsigned rank;
+	for (rank = 0; found.size() < k && kb.find(KBest::F, Set::empty(N), V, rank); rank++) {
+		TreeNode<Set> *root = kb.build(KBest::F, Set::empty(N), V, rank, (TreeNode<Set>*)NULL);
+		
+		std::vector<KBest::Key> key;
+		tree_key(root, trees, key);
+		std::sort(key.begin(), key.end());
+		
+		if (found.insert(key).second) root->output();
+		delete root;
+	}
+	
+	if (found.size() < k) vbprintf("Only %u distinct %s exist.\n", (unsigned)found.size(), trees ? "junction trees" : "graphs");
+	vbprintf("RPTs enumerated: %u, entries reached: %llu\n", rank, kb.reached());
+	
+	deallocate_tables();
+}
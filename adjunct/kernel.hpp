@@ -0,0 +1,1192 @@
+/*
+ *  Adjunct
+ *  
+ *  Copyright 2015 Kustaa Kangas <jwkangas(at)cs.helsinki.fi>
+ *  
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *  
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *  
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef KERNEL_HPP
+#define KERNEL_HPP
+
+#include <vector>
+#include <cfloat>
+#include <cmath>
+
+#include "common.hpp"
+#include "threadpool.hpp"
+#include "transform.hpp"
+#include "tablefile.hpp"
+#include "logsumexp.hpp"
+#include "shards.hpp"
+#include "stats.hpp"
+
+
+// The recurrences over the space of RPTs are
+//
+//   f(S,R) = sum over D in [Ø,R], 0 < |S u D| <= W  of  p(S u D) g(S u D, R \ D)
+//   g(C,U) = sum over R in [{u},U], u first in U    of  h(C,R) g(C, U \ R)
+//   h(C,R) = sum over S in [Ø,C), S != C            of  f(S,R) / p(S)
+//
+// with g(C,Ø) = 1. They are evaluated in a semiring given at compile time,
+// where plus is the sum above, times is the product, over is the division, and
+// weight(X) is the weight p(X) of a clique or a separator X. The value zero
+// also marks entries that have not been computed yet.
+
+
+// maximization of scores in log space
+struct MaxSemiring
+{
+	typedef double value;
+	
+	// the first element of R can always be put in a clique with an empty separator,
+	// this is still guaranteed to consider at least one optimal solution
+	static const bool fix_first = true;
+	
+	static const char *name() { return "max"; }
+	
+	static value zero() { return -INFTY; }
+	static value one() { return 0.0; }
+	static value plus(value x, value y) { return x > y ? x : y; }
+	static value times(value x, value y) { return x + y; }
+	static value over(value x, value y) { return x - y; }
+	static value weight(Set X) { return local_score(X); }
+};
+
+// summation of scores in log space
+struct SumSemiring
+{
+	typedef double value;
+	
+	static const bool fix_first = false;
+	
+	static const char *name() { return "sum"; }
+	
+	static value zero() { return -INFTY; }
+	static value one() { return 0.0; }
+	static value plus(value x, value y) { return logsum(x, y); }
+	static value times(value x, value y) { return x + y; }
+	static value over(value x, value y) { return x - y; }
+	static value weight(Set X) { return local_score(X); }
+};
+
+// exact counting of RPTs, values that overflow saturate to count_overflow
+struct CountSemiring
+{
+	typedef count_t value;
+	
+	static const bool fix_first = false;
+	
+	static const char *name() { return "count"; }
+	
+	static value zero() { return 0; }
+	static value one() { return 1; }
+	
+	static value plus(value x, value y)
+	{
+		value z;
+		return __builtin_add_overflow(x, y, &z) ? count_overflow : z;
+	}
+	
+	static value times(value x, value y)
+	{
+		value z;
+		return __builtin_mul_overflow(x, y, &z) ? count_overflow : z;
+	}
+	
+	static value over(value x, value) { return x; }
+	static value weight(Set) { return 1; }
+};
+
+
+
+
+// iterates over the separators S of h(C,R), i.e., the proper subsets of C
+struct h_iterator : public range_iterator<Set>
+{
+	h_iterator(Set C) : range_iterator<Set>(N, Set::empty(N), C, 1, 0) {}
+};
+
+// iterates over the sets R of g(C,U), i.e., the subsets of U containing its first element
+struct g_iterator : public range_iterator<Set>
+{
+	g_iterator(Set U) : range_iterator<Set>(N, Set::empty(N) | U.first(N), U) {}
+};
+
+// iterates over the sets D of f(S,R), i.e., the non-empty subsets of R with |S u D| <= W;
+// if fix_first is set and S is empty, only sets D containing the first element of R
+struct f_iterator : public range_k_iterator<Set>
+{
+	static bool fixed(Set S, bool fix_first)
+	{
+		return fix_first && S.is_empty();
+	}
+	
+	f_iterator(Set S, Set R, bool fix_first) : range_k_iterator<Set>(N, W - S.cardinality(N),
+		fixed(S, fix_first) ? Set::empty(N) | R.first(N) : Set::empty(N), R)
+	{
+		assert(W > S.cardinality(N));
+		
+		// D is never empty
+		if (!fixed(S, fix_first)) ++(*this);
+	}
+};
+
+
+
+
+// Adds up the terms of a sum one at a time, and if arg is given, stores the
+// set of the term that last changed the sum there.
+template <typename Semiring>
+struct Accumulator
+{
+	typedef typename Semiring::value value;
+	
+	value sum;
+	Set *arg;
+	
+	Accumulator(Set *arg) : sum(Semiring::zero()), arg(arg) {}
+	
+	void add(value term, Set set)
+	{
+		value s = Semiring::plus(sum, term);
+		if (arg != NULL && s != sum) *arg = set;
+		sum = s;
+	}
+	
+	value result() { return sum; }
+};
+
+// sums in log space take the log once per block of terms (see logsumexp.hpp)
+template <>
+struct Accumulator<SumSemiring> : public LogSumExp
+{
+	Accumulator(Set *) {}
+	
+	void add(double term, Set) { LogSumExp::add(term); }
+	double result() { return value(); }
+};
+
+
+// The terms and sums of the recurrences. The entries that a sum depends on are
+// read through the Tables policy, which either computes them on demand or reads
+// them from filled tables.
+template <typename Semiring>
+struct Recurrence
+{
+	typedef typename Semiring::value value;
+	
+	// term of h(C,R) for the separator S
+	template <typename Tables>
+	static value h_term(Tables &t, Set S, Set R)
+	{
+		return Semiring::over(t.f(S, R), Semiring::weight(S));
+	}
+	
+	// term of g(C,U) for the set R
+	template <typename Tables>
+	static value g_term(Tables &t, Set C, Set U, Set R)
+	{
+		return Semiring::times(t.h(C, R), t.g(C, U ^ R));
+	}
+	
+	// term of f(S,R) for the set D
+	template <typename Tables>
+	static value f_term(Tables &t, Set S, Set R, Set D)
+	{
+		Set C = S | D;
+		return Semiring::times(Semiring::weight(C), t.g(C, R ^ D));
+	}
+	
+	// adds a term to a sum, and if arg is given and the term changes the sum,
+	// stores its set there (for max, the first term that reaches the maximum)
+	static void add(value &sum, value term, Set set, Set *arg)
+	{
+		value s = Semiring::plus(sum, term);
+		if (arg != NULL && s != sum) *arg = set;
+		sum = s;
+	}
+	
+	template <typename Tables>
+	static value h(Tables &t, Set C, Set R, Set *arg = NULL)
+	{
+		Accumulator<Semiring> sum(arg);
+		for (h_iterator it(C); it.has_next(); ++it) {
+			STAT_TERM(STAT_H);
+			sum.add(h_term(t, it.set(), R), it.set());
+		}
+		return sum.result();
+	}
+	
+	template <typename Tables>
+	static value g(Tables &t, Set C, Set U, Set *arg = NULL)
+	{
+		if (U.is_empty()) return Semiring::one();
+		
+		Accumulator<Semiring> sum(arg);
+		for (g_iterator it(U); it.has_next(); ++it) {
+			STAT_TERM(STAT_G);
+			sum.add(g_term(t, C, U, it.set()), it.set());
+		}
+		return sum.result();
+	}
+	
+	template <typename Tables>
+	static value f(Tables &t, Set S, Set R, Set *arg = NULL)
+	{
+		Accumulator<Semiring> sum(arg);
+		for (f_iterator it(S, R, Semiring::fix_first); it.has_next(); ++it) {
+			STAT_TERM(STAT_F);
+			sum.add(f_term(t, S, R, it.set()), it.set());
+		}
+		return sum.result();
+	}
+};
+
+
+
+
+// the table type for values of type T; scores may be stored in single precision
+template <typename T>
+struct TableArray
+{
+	typedef DisjointPairArray<T> type;
+};
+
+template <>
+struct TableArray<double>
+{
+	typedef ScoreArray type;
+};
+
+// the DP tables f, g and h of a semiring, and optionally the sets D, R and S
+// of the terms that determine each entry (see Recurrence::add)
+template <typename Semiring>
+struct TableSet
+{
+	typedef typename Semiring::value value;
+	typedef typename TableArray<value>::type Array;
+	typedef DisjointPairArray<Set> ArgArray;
+	
+	Array *f_values, *g_values, *h_values;
+	ArgArray *f_args, *g_args, *h_args;
+	
+	TableSet(Array *f_values, Array *g_values, Array *h_values) :
+		f_values(f_values), g_values(g_values), h_values(h_values),
+		f_args(NULL), g_args(NULL), h_args(NULL) {}
+	
+	// stores the argument of an entry if arguments are recorded
+	static void record(ArgArray *args, Set X, Set Y, Set arg)
+	{
+		if (args != NULL) args->set(X.bits, Y.bits, arg);
+	}
+};
+
+// computes entries on demand by memoized recursion; a computed entry is
+// returned as stored, so that in single precision (-f) it is the same value
+// whichever call computed it
+template <typename Semiring>
+struct MemoTables : public TableSet<Semiring>
+{
+	typedef typename Semiring::value value;
+	typedef Recurrence<Semiring> Rec;
+	typedef typename TableSet<Semiring>::Array Array;
+	
+	MemoTables(Array *f_values, Array *g_values, Array *h_values) :
+		TableSet<Semiring>(f_values, g_values, h_values) {}
+	
+	value h(Set C, Set R)
+	{
+		value cached = this->h_values->get(C.bits, R.bits);
+		if (cached != Semiring::zero()) {
+			STAT_HIT(STAT_H);
+			return cached;
+		}
+		STAT_MISS(STAT_H);
+		
+		Set arg = Set::empty(N);
+		value sum = Rec::h(*this, C, R, this->h_args ? &arg : NULL);
+		this->h_values->set(C.bits, R.bits, sum);
+		this->record(this->h_args, C, R, arg);
+		return this->h_values->get(C.bits, R.bits);
+	}
+	
+	value g(Set C, Set U)
+	{
+		value cached = this->g_values->get(C.bits, U.bits);
+		if (cached != Semiring::zero()) {
+			STAT_HIT(STAT_G);
+			return cached;
+		}
+		STAT_MISS(STAT_G);
+		
+		Set arg = Set::empty(N);
+		value sum = Rec::g(*this, C, U, this->g_args ? &arg : NULL);
+		this->g_values->set(C.bits, U.bits, sum);
+		this->record(this->g_args, C, U, arg);
+		return this->g_values->get(C.bits, U.bits);
+	}
+	
+	value f(Set S, Set R)
+	{
+		value cached = this->f_values->get(S.bits, R.bits);
+		if (cached != Semiring::zero()) {
+			STAT_HIT(STAT_F);
+			return cached;
+		}
+		STAT_MISS(STAT_F);
+		
+		Set arg = Set::empty(N);
+		value sum = Rec::f(*this, S, R, this->f_args ? &arg : NULL);
+		this->f_values->set(S.bits, R.bits, sum);
+		this->record(this->f_args, S, R, arg);
+		return this->f_values->get(S.bits, R.bits);
+	}
+};
+
+// reads entries directly from tables in which they have already been filled
+template <typename Semiring>
+struct FilledTables : public TableSet<Semiring>
+{
+	typedef typename Semiring::value value;
+	typedef typename TableSet<Semiring>::Array Array;
+	
+	FilledTables(Array *f_values, Array *g_values, Array *h_values) :
+		TableSet<Semiring>(f_values, g_values, h_values) {}
+	
+	FilledTables(const TableSet<Semiring> &tables) : TableSet<Semiring>(tables) {}
+	
+	value h(Set C, Set R)
+	{
+		STAT_HIT(STAT_H);
+		return this->h_values->get(C.bits, R.bits);
+	}
+	
+	value g(Set C, Set U)
+	{
+		STAT_HIT(STAT_G);
+		return this->g_values->get(C.bits, U.bits);
+	}
+	
+	value f(Set S, Set R)
+	{
+		STAT_HIT(STAT_F);
+		return this->f_values->get(S.bits, R.bits);
+	}
+};
+
+typedef MemoTables<MaxSemiring> MaxTables;
+typedef MemoTables<SumSemiring> SumTables;
+typedef MemoTables<CountSemiring> CountTables;
+typedef FilledTables<SumSemiring> FilledSumTables;
+
+
+
+
+// Evaluates g(C,·) for a clique C by fast subset convolution instead of
+// summing over the sets R of each g(C,U).
+//
+// Every term of g(C,U) is a partition of U into blocks R, weighted by the
+// product of h(C,R). Counting each partition once for each element of U gives
+//
+//   |U| g(C,U) = sum over R in [Ø,U], R != Ø  of  |R| h(C,R) g(C, U \ R)
+//
+// which is a subset convolution ranked by |R|. The levels of fill_tables are
+// the ranks |U| = k, so the convolution is evaluated online: after level k
+// of h is filled, the rank k of |R| h(C,R) is zeta-transformed, the ranked
+// product with the transforms of g of ranks below k is Moebius-transformed,
+// and the result gives g(C,U) for |U| = k, which is then zeta-transformed for
+// the following levels. With m = |V \ C|, this takes O(m^2 2^m) time per C
+// instead of O(3^m), but keeps the transforms of all ranks, i.e., 2(m+1)
+// arrays of 2^m numbers per C, until the last level of C. This is about
+// 2(m+1) times the memory of the g table, or twice that for counting.
+//
+// The transforms need subtraction, which the max semiring does not have, so
+// there g is always evaluated by the exact sums.
+template <typename Semiring>
+struct SubsetConvolution
+{
+	static const bool available = false;
+	
+	SubsetConvolution(FilledTables<Semiring> &, std::vector<Set> &) {}
+	
+	void fill(size_t, unsigned) {}
+	void report() {}
+};
+
+
+// the parts common to all semirings
+template <typename Semiring>
+struct ConvolutionBase
+{
+	typedef Recurrence<Semiring> Rec;
+	
+	FilledTables<Semiring> &t;
+	std::vector<Set> &cliques;
+	
+	// statistics of each clique, kept separately for each thread
+	std::vector<unsigned long long> entries, recomputed;
+	
+	ConvolutionBase(FilledTables<Semiring> &t, std::vector<Set> &cliques) :
+		t(t), cliques(cliques), entries(cliques.size(), 0), recomputed(cliques.size(), 0) {}
+	
+	// maps a short index of DisjointPairArray back to a set U disjoint from C
+	static Set expand(Set C, set_word u)
+	{
+		Set U = Set::empty(N);
+		for (unsigned i = 0, j = 0; i < N; i++) {
+			if (C.has(i)) continue;
+			if (u & ((set_word)1 << j++)) U.set(i);
+		}
+		return U;
+	}
+	
+	// fills g(C,U) for all U with |U| = k by the exact sums
+	void fill_exact(Set C, unsigned k)
+	{
+		Set V = Set::complete(N);
+		for (range_exact_iterator<Set> it(N, k, Set::empty(N), V ^ C); it.has_next(); ++it) {
+			t.g_values->set(C.bits, it.set().bits, Rec::g(t, C, it.set()));
+		}
+	}
+	
+	// recomputes g(C,U) by the exact sum
+	typename Semiring::value recompute(size_t c, set_word u)
+	{
+		recomputed[c]++;
+		Set C = cliques[c];
+		return Rec::g(t, C, expand(C, u));
+	}
+	
+	void report()
+	{
+		unsigned long long n_entries = 0, n_recomputed = 0;
+		for (unsigned c = 0; c < cliques.size(); c++) {
+			n_entries += entries[c];
+			n_recomputed += recomputed[c];
+		}
+		
+		vbprintf("Subset convolution: %llu entries of g, %llu of them recomputed exactly\n",
+			n_entries, n_recomputed);
+	}
+};
+
+
+// In the sum semiring the transforms are computed in linear space. To keep
+// the values closer to 1, each set U is scaled by exp(-a(U)) where a(U) is the
+// sum of h(C,{v}) over v in U; since this is additive over disjoint sets, it
+// scales every term of g(C,U) equally. Scores may still span thousands of
+// nats, so long doubles are used for their larger exponent range.
+//
+// The Moebius transform of non-negative values is accurate relative to the
+// sum of the magnitudes that it cancels, which is the zeta transform of the
+// ranked product. Entries whose relative error bound exceeds the tolerance
+// are recomputed by the exact sum. With strong dependencies between the
+// variables this cancellation is severe, so if most entries of a rank fail,
+// the clique falls back to the exact sums for the remaining levels.
+template <>
+struct SubsetConvolution<SumSemiring> : public ConvolutionBase<SumSemiring>
+{
+	static const bool available = true;
+	
+	// relative error allowed in an entry of g
+	static constexpr long double tolerance = 1e-12;
+	
+	typedef std::vector<long double> Array;
+	
+	struct Transforms
+	{
+		unsigned m;
+		
+		// scaling h(C,{v}) of each element v not in C
+		Array a;
+		
+		// zeta transforms of |R| h(C,R) and g(C,U) of each rank
+		std::vector<Array> zh, zg;
+		
+		Transforms(unsigned m) : m(m), a(m), zh(m + 1), zg(m + 1)
+		{
+			// g(C,Ø) = 1
+			zg[0].assign((size_t)1 << m, 1.0);
+		}
+		
+		long double scale(set_word u)
+		{
+			long double s = 0;
+			for (unsigned i = 0; i < m; i++) {
+				if (u & ((set_word)1 << i)) s += a[i];
+			}
+			return s;
+		}
+	};
+	
+	std::vector<Transforms*> transforms;
+	std::vector<long double> max_error;
+	
+	SubsetConvolution(FilledTables<SumSemiring> &t, std::vector<Set> &cliques) :
+		ConvolutionBase<SumSemiring>(t, cliques), transforms(cliques.size(), NULL), max_error(cliques.size(), 0) {}
+	
+	~SubsetConvolution()
+	{
+		for (unsigned c = 0; c < transforms.size(); c++) delete transforms[c];
+	}
+	
+	// fills g(C,U) for the clique C = cliques[c] and all U with |U| = k
+	void fill(size_t c, unsigned k)
+	{
+		Set C = cliques[c];
+		unsigned m = N - C.cardinality(N);
+		if (k > m) return;
+		
+		if (k == 0) {
+			t.g_values->set(C.bits, 0, SumSemiring::one());
+			if (m > 0) transforms[c] = new Transforms(m);
+			return;
+		}
+		
+		Transforms *tr = transforms[c];
+		if (tr == NULL) {
+			fill_exact(C, k);
+			return;
+		}
+		
+		set_word size = (set_word)1 << m;
+		ScoreArray *h = t.h_values, *g = t.g_values;
+		
+		if (k == 1) {
+			for (unsigned i = 0; i < m; i++) tr->a[i] = h->get_short(C.bits, (set_word)1 << i);
+		}
+		
+		// rank k of |R| h(C,R)
+		Array &zh = tr->zh[k];
+		zh.assign(size, 0);
+		for (set_word u = 0; u < size; u++) {
+			if (uintset(u).cardinality(m) != k) continue;
+			zh[u] = k * expl(h->get_short(C.bits, u) - tr->scale(u));
+		}
+		zeta_transform(zh, m);
+		
+		// ranked product, and the magnitudes that its inverse cancels
+		Array p(size);
+		ranked_product(tr->zh, tr->zg, k, p);
+		Array q(p);
+		moebius_transform(p, m);
+		zeta_transform(q, m);
+		
+		Array &zg = tr->zg[k];
+		zg.assign(size, 0);
+		long double eps = (4 * m + 4) * LDBL_EPSILON;
+		unsigned long long n = 0, failed = 0;
+		
+		for (set_word u = 0; u < size; u++) {
+			if (uintset(u).cardinality(m) != k) continue;
+			long double s = tr->scale(u);
+			
+			long double value = p[u] / k;
+			long double error = eps * q[u] / k / value;
+			n++;
+			
+			// also fails on overflow, underflow and negative values
+			if (value > 0 && error <= tolerance) {
+				if (error > max_error[c]) max_error[c] = error;
+				g->set_short(C.bits, u, logl(value) + s);
+			} else {
+				double x = recompute(c, u);
+				g->set_short(C.bits, u, x);
+				value = expl(x - s);
+				failed++;
+			}
+			zg[u] = value;
+		}
+		zeta_transform(zg, m);
+		entries[c] += n;
+		
+		if (k == m || 2 * failed > n) {
+			delete tr;
+			transforms[c] = NULL;
+		}
+	}
+	
+	void report()
+	{
+		ConvolutionBase<SumSemiring>::report();
+		
+		long double error = 0;
+		for (unsigned c = 0; c < cliques.size(); c++) {
+			if (max_error[c] > error) error = max_error[c];
+		}
+		vbprintf("Maximum relative error bound of the other entries: %Lg\n", error);
+	}
+};
+
+
+// In the counting semiring the transforms are exact modulo 2^128, and thus
+// k g(C,U) is exact if it is less than 2^128. Since all counts are
+// non-negative, it is at most the ranked product before the Moebius transform,
+// which is also computed in long doubles without cancellation. If that bound
+// reaches 2^127, or if any count it depends on has saturated, the entry is
+// recomputed by the exact sum, which saturates properly.
+template <>
+struct SubsetConvolution<CountSemiring> : public ConvolutionBase<CountSemiring>
+{
+	static const bool available = true;
+	
+	typedef std::vector<count_t> Array;
+	typedef std::vector<long double> Bounds;
+	
+	struct Transforms
+	{
+		// zeta transforms of |R| h(C,R) and g(C,U) of each rank
+		std::vector<Array> zh, zg;
+		
+		// the same in long doubles
+		std::vector<Bounds> bh, bg;
+		
+		Transforms(unsigned m) : zh(m + 1), zg(m + 1), bh(m + 1), bg(m + 1)
+		{
+			// g(C,Ø) = 1
+			zg[0].assign((size_t)1 << m, 1);
+			bg[0].assign((size_t)1 << m, 1);
+		}
+	};
+	
+	std::vector<Transforms*> transforms;
+	
+	SubsetConvolution(FilledTables<CountSemiring> &t, std::vector<Set> &cliques) :
+		ConvolutionBase<CountSemiring>(t, cliques), transforms(cliques.size(), NULL) {}
+	
+	~SubsetConvolution()
+	{
+		for (unsigned c = 0; c < transforms.size(); c++) delete transforms[c];
+	}
+	
+	// fills g(C,U) for the clique C = cliques[c] and all U with |U| = k
+	void fill(size_t c, unsigned k)
+	{
+		Set C = cliques[c];
+		unsigned m = N - C.cardinality(N);
+		if (k > m) return;
+		
+		if (k == 0) {
+			t.g_values->set(C.bits, 0, CountSemiring::one());
+			if (m > 0) transforms[c] = new Transforms(m);
+			return;
+		}
+		
+		Transforms *tr = transforms[c];
+		set_word size = (set_word)1 << m;
+		count_t *h = t.h_values->row(C.bits);
+		count_t *g = t.g_values->row(C.bits);
+		
+		// rank k of |R| h(C,R), where saturated counts count as 2^128
+		Array &zh = tr->zh[k];
+		Bounds &bh = tr->bh[k];
+		zh.assign(size, 0);
+		bh.assign(size, 0);
+		for (set_word u = 0; u < size; u++) {
+			if (uintset(u).cardinality(m) != k) continue;
+			zh[u] = k * h[u];
+			bh[u] = h[u] == count_overflow ? k * ldexpl(1, 128) : k * (long double)h[u];
+		}
+		zeta_transform(zh, m);
+		zeta_transform(bh, m);
+		
+		Array p(size);
+		Bounds b(size);
+		ranked_product(tr->zh, tr->zg, k, p);
+		ranked_product(tr->bh, tr->bg, k, b);
+		moebius_transform(p, m);
+		
+		Array &zg = tr->zg[k];
+		Bounds &bg = tr->bg[k];
+		zg.assign(size, 0);
+		bg.assign(size, 0);
+		
+		for (set_word u = 0; u < size; u++) {
+			if (uintset(u).cardinality(m) != k) continue;
+			entries[c]++;
+			
+			if (b[u] < ldexpl(1, 127)) g[u] = p[u] / k;
+			else g[u] = recompute(c, u);
+			
+			zg[u] = g[u];
+			bg[u] = g[u] == count_overflow ? ldexpl(1, 128) : (long double)g[u];
+		}
+		zeta_transform(zg, m);
+		zeta_transform(bg, m);
+		
+		if (k == m) {
+			delete tr;
+			transforms[c] = NULL;
+		}
+	}
+};
+
+
+
+
+// Fills h(C,R) for a fixed R and all cliques C by a transform over the subsets
+// of V \ R of size at most W, instead of summing over the subsets S of each C.
+// With x(S) = f(S,R) / p(S), the h(C,R) are the sums of x over the proper
+// subsets of C. Going through the elements i of V \ R in order, let z_i(C) and
+// b_i(C) be the sums of x(S) over the subsets S of C, and the proper subsets
+// of C, that agree with C on the elements after i. Then for i in C
+//
+//   z_i(C) = z_{i-1}(C) + z_{i-1}(C \ i)
+//   b_i(C) = b_{i-1}(C) + z_{i-1}(C \ i)
+//
+// starting from z_0 = x and b_0 = 0, and h(C,R) = b_m(C) for m = |V \ R|.
+// This takes O(m L) time, where L is the number of sets of size at most W,
+// instead of the sum of 2^|C| over them. Only subtraction-free operations are
+// used, so this works in every semiring, but the sums are taken in another
+// order than in h_iterator. For max, the recorded argument S of h(C,R) is
+// then some maximizing separator, not necessarily the first. The sets are
+// indexed by their short indices in the DisjointPairArray rows of R, in
+// arrays of 2^m values that are reused by each thread and touched only at the
+// sets of size at most W.
+template <typename Semiring>
+void fill_h_transform(FilledTables<Semiring> &t, Set R)
+{
+	typedef typename Semiring::value value;
+	typedef Recurrence<Semiring> Rec;
+	
+	static thread_local std::vector<value> z, b;
+	
+	// the separators S that determine z and b, if arguments are recorded
+	static thread_local std::vector<Set> z_arg, b_arg;
+	bool args = t.h_args != NULL;
+	
+	Set V = Set::complete(N);
+	unsigned m = N - R.cardinality(N);
+	if (z.size() < ((size_t)1 << m)) {
+		z.resize((size_t)1 << m);
+		b.resize((size_t)1 << m);
+	}
+	if (args && z_arg.size() < ((size_t)1 << m)) {
+		z_arg.resize((size_t)1 << m);
+		b_arg.resize((size_t)1 << m);
+	}
+	
+	for (range_k_iterator<Set> it(N, W, Set::empty(N), V ^ R); it.has_next(); ++it) {
+		Set S = it.set();
+		set_word u = t.h_values->index(R.bits, S.bits);
+		if (S.cardinality(N) < W) z[u] = Semiring::over(t.f(S, R), Semiring::weight(S));
+		b[u] = Semiring::zero();
+		if (args) z_arg[u] = S;
+	}
+	
+	Set M = Set::complete(m);
+	for (unsigned i = 0; i < m; i++) {
+		Set I = Set::empty(m) | i;
+		for (range_k_iterator<Set> it(m, W, I, M); it.has_next(); ++it) {
+			set_word u = it.set().bits;
+			set_word v = u ^ I.bits;
+			STAT_TERM(STAT_H);
+			Rec::add(b[u], z[v], args ? z_arg[v] : Set::empty(N), args ? &b_arg[u] : NULL);
+			if (it.set().cardinality(m) < W) {
+				Rec::add(z[u], z[v], args ? z_arg[v] : Set::empty(N), args ? &z_arg[u] : NULL);
+			}
+		}
+	}
+	
+	for (range_k_iterator<Set> it(N, W, Set::empty(N), V ^ R); it.has_next(); ++it) {
+		Set C = it.set();
+		if (C.is_empty()) continue;
+		set_word u = t.h_values->index(R.bits, C.bits);
+		t.h_values->set(C.bits, R.bits, b[u]);
+		if (args) t.h_args->set(C.bits, R.bits, b_arg[u]);
+	}
+}
+
+
+// Runs the parallel loops of fill_tables with the threads of this process. With
+// several processes, each runs only its share of the items, every count-th
+// from its index, and waits for the others after each loop.
+struct ShardedPool
+{
+	Shards *shards;
+	ThreadPool threads;
+	
+	ShardedPool(Shards *shards, unsigned n_threads) : shards(shards), threads(n_threads) {}
+	
+	void run(size_t n, std::function<void(size_t)> f)
+	{
+		if (shards == NULL) {
+			threads.run(n, f);
+			return;
+		}
+		
+		size_t index = shards->index, count = shards->count;
+		threads.run(n > index ? (n - index + count - 1) / count : 0, [&](size_t i) { f(index + i * count); });
+		shards->wait();
+	}
+};
+
+
+// Fills the entries (x,y) of a table for all x in xs and all y of size k
+// disjoint from x by calling fill(x, y). The first sets x are distributed
+// among the threads.
+template <typename Fill>
+void fill_level(ShardedPool &pool, std::vector<Set> &xs, unsigned k, Fill fill)
+{
+	Set V = Set::complete(N);
+	
+	pool.run(xs.size(), [&](size_t i) {
+		Set x = xs[i];
+		for (range_exact_iterator<Set> yt(N, k, Set::empty(N), V ^ x); yt.has_next(); ++yt) {
+			fill(x, yt.set());
+		}
+	});
+}
+
+
+// Fills the tables f, g and h bottom-up in order of increasing |R| (or |U|).
+// On each level k, f(S,R) depends only on g(C,U) with |U| < k, h(C,R) only on
+// f(S,R) with the same R, and g(C,U) only on h(C,R) with |R| <= k and g(C,U')
+// with |U'| < k. Thus each level is filled in the order f, h, g, and all
+// entries of one table on one level are independent of each other. These are
+// filled in parallel by opt_threads threads, with a barrier after each table.
+// The entries of f and g sum their terms in the same order as in the memoized
+// recursion, and h is filled by fill_h_transform for each R, so the tables do
+// not depend on the number of threads. With subset convolution (-z), g is
+// evaluated one clique at a time instead. With several processes (--procs),
+// the workers are forked here, share the items of each loop with the
+// coordinator, and exit once the tables are filled.
+template <typename Semiring>
+void fill_tables(TableSet<Semiring> &tables)
+{
+	typedef Recurrence<Semiring> Rec;
+	
+	FilledTables<Semiring> t(tables);
+	Set V = Set::complete(N);
+	
+	// separators S with |S| < W
+	std::vector<Set> separators;
+	for (range_k_iterator<Set> it(N, W - 1, Set::empty(N), V); it.has_next(); ++it) {
+		separators.push_back(it.set());
+	}
+	
+	// cliques C with 0 < |C| <= W
+	std::vector<Set> cliques;
+	for (range_k_iterator<Set> it(N, W, Set::empty(N), V); it.has_next(); ++it) {
+		if (!it.set().is_empty()) cliques.push_back(it.set());
+	}
+	
+	// evaluate g by subset convolution if requested and available, within one
+	// process, since its state is kept for each clique
+	bool convolution = opt_subset_convolution && SubsetConvolution<Semiring>::available && opt_procs == 1;
+	SubsetConvolution<Semiring> conv(t, cliques);
+	
+	Shards *shards = opt_procs > 1 ? new Shards(opt_procs) : NULL;
+	ShardedPool pool(shards, opt_threads);
+	
+	for (unsigned k = 0; k <= N; k++) {
+		// R is never empty in f(S,R) and h(C,R)
+		if (k > 0) {
+			fill_level(pool, separators, k, [&](Set S, Set R) {
+				Set D = Set::empty(N);
+				t.f_values->set(S.bits, R.bits, Rec::f(t, S, R, t.f_args ? &D : NULL));
+				t.record(t.f_args, S, R, D);
+			});
+			std::vector<Set> rs;
+			for (range_exact_iterator<Set> it(N, k, Set::empty(N), V); it.has_next(); ++it) {
+				rs.push_back(it.set());
+			}
+			pool.run(rs.size(), [&](size_t i) { fill_h_transform(t, rs[i]); });
+		}
+		if (convolution) {
+			pool.run(cliques.size(), [&](size_t c) { conv.fill(c, k); });
+			continue;
+		}
+		fill_level(pool, cliques, k, [&](Set C, Set U) {
+			Set R = Set::empty(N);
+			t.g_values->set(C.bits, U.bits, Rec::g(t, C, U, t.g_args ? &R : NULL));
+			t.record(t.g_args, C, U, R);
+		});
+	}
+	
+	if (shards != NULL) {
+		shards->finish();
+		delete shards;
+	}
+	
+	if (convolution) conv.report();
+}
+
+
+
+
+// Computes f(Ø,V) and all entries it depends on, i.e., the same entries as the
+// memoized recursion, in parallel by opt_threads threads. Each entry is a task
+// in a work-stealing scheduler. A task sums the terms of its entry in order
+// until it reaches a term that depends on an entry that is not done yet. It
+// then claims such an entry with an atomic state, pushes it as a new task and
+// pushes itself after it, to be resumed from the same term once the claimed
+// entry is done. Thus no thread ever waits for another one and no entry is
+// computed twice. Other threads steal the oldest tasks, which are those closest
+// to the root, and resuming them claims the entries further along their sums.
+// Each entry sums its terms in the same order as in the memoized recursion, so
+// the tables do not depend on the number of threads. Afterwards, the tables can
+// be read through MemoTables as if they had been filled by the recursion.
+template <typename Semiring>
+struct ParallelSolver
+{
+	typedef typename Semiring::value value;
+	typedef Recurrence<Semiring> Rec;
+	typedef typename TableSet<Semiring>::Array Array;
+	typedef typename TableSet<Semiring>::ArgArray ArgArray;
+	typedef DisjointPairArray<std::atomic<unsigned char> > StateArray;
+	
+	enum { UNCLAIMED = 0, CLAIMED, DONE };
+	// in the order of StatTable
+	enum { F = 0, G, H };
+	
+	// computation of the entry (x,y) of table f, g or h, where sum is the sum
+	// of the terms before position, arg the set of the term that determined it,
+	// and the terms before scan have already been looked at for claiming.
+	// Positions are those of the iterator, and added and scanned are its sets
+	// at position - 1 and scan - 1, from which a resumed task continues.
+	struct Task
+	{
+		unsigned char table;
+		set_word x, y;
+		long long unsigned position, scan;
+		value sum;
+		Set arg, added, scanned;
+	};
+	
+	// reads the entries that the terms depend on, claiming those that are not done
+	struct Probe
+	{
+		ParallelSolver &solver;
+		std::vector<Task> claimed;
+		bool missing;
+		
+		Probe(ParallelSolver &solver) : solver(solver), missing(false) {}
+		
+		value h(Set C, Set R) { return solver.probe(*this, H, C, R); }
+		value f(Set S, Set R) { return solver.probe(*this, F, S, R); }
+		
+		value g(Set C, Set U)
+		{
+			// g(C,Ø) is not stored
+			if (U.is_empty()) return Semiring::one();
+			return solver.probe(*this, G, C, U);
+		}
+	};
+	
+	// the state tables have the same layout as the value tables
+	Array *values[3];
+	ArgArray *args[3];
+	StateArray *states[3];
+	WorkDeques<Task> queues;
+	
+	ParallelSolver(TableSet<Semiring> &tables) : queues(opt_threads)
+	{
+		values[F] = tables.f_values;
+		values[G] = tables.g_values;
+		values[H] = tables.h_values;
+		args[F] = tables.f_args;
+		args[G] = tables.g_args;
+		args[H] = tables.h_args;
+		
+		for (unsigned i = 0; i < 3; i++) states[i] = new StateArray(N, W, ALLOCATE_LAZY);
+	}
+	
+	~ParallelSolver()
+	{
+		for (unsigned i = 0; i < 3; i++) delete states[i];
+	}
+	
+	value probe(Probe &p, unsigned char table, Set X, Set Y)
+	{
+		long long unsigned i = values[table]->index(X.bits, Y.bits);
+		std::atomic<unsigned char> &state = states[table]->row(X.bits)[i];
+		
+		unsigned char s = state.load(std::memory_order_acquire);
+		if (s == DONE) {
+			STAT_HIT(table);
+			return values[table]->get_short(X.bits, i);
+		}
+		
+		// a miss is counted once, by the thread that claims the entry
+		if (s == UNCLAIMED && state.compare_exchange_strong(s, CLAIMED)) {
+			STAT_MISS(table);
+			Task task = { table, X.bits, Y.bits, 0, 0, Semiring::zero(), Set::empty(N), Set::empty(N), Set::empty(N) };
+			p.claimed.push_back(task);
+		}
+		p.missing = true;
+		
+		return Semiring::zero();
+	}
+	
+	// Adds the terms from the position of the task on to its sum until a term
+	// depends on an entry that is not done. Then continues from the scan
+	// position only until one such entry has been claimed, so that each term is
+	// looked at for claiming at most once. The iterator jumps to both positions
+	// instead of stepping over the terms before them, so that an entry that is
+	// suspended many times is still summed in time linear in its terms.
+	// Returns true if all terms were added.
+	template <typename Iterator, typename Term>
+	bool resume(Probe &p, Task &task, Iterator it, Term term)
+	{
+		if (task.position > 0) {
+			it.seek(task.position - 1, task.added);
+			++it;
+		}
+		
+		for (; it.has_next(); ++it) {
+			value x = term(it.set());
+			if (!p.missing) {
+				STAT_TERM(task.table);
+				Rec::add(task.sum, x, it.set(), args[task.table] ? &task.arg : NULL);
+				task.position = it.index + 1;
+				task.added = it.set();
+				continue;
+			}
+			
+			if (it.index >= task.scan) {
+				task.scan = it.index + 1;
+				task.scanned = it.set();
+			}
+			if (!p.claimed.empty()) break;
+			
+			// skip the terms that have already been looked at
+			if (it.index + 1 < task.scan) it.seek(task.scan - 1, task.scanned);
+		}
+		
+		return !p.missing;
+	}
+	
+	// runs a task on thread i, returns false if it made no progress
+	bool execute(unsigned i, Task task)
+	{
+		Probe p(*this);
+		Set X(task.x), Y(task.y);
+		
+		bool complete;
+		switch (task.table) {
+			case F:
+				complete = resume(p, task, f_iterator(X, Y, Semiring::fix_first),
+					[&](Set D) { return Rec::f_term(p, X, Y, D); });
+				break;
+			case G:
+				complete = resume(p, task, g_iterator(Y),
+					[&](Set R) { return Rec::g_term(p, X, Y, R); });
+				break;
+			default:
+				complete = resume(p, task, h_iterator(X),
+					[&](Set S) { return Rec::h_term(p, S, Y); });
+				break;
+		}
+		
+		if (complete) {
+			values[task.table]->set(task.x, task.y, task.sum);
+			TableSet<Semiring>::record(args[task.table], X, Y, task.arg);
+			states[task.table]->at(task.x, task.y).store(DONE, std::memory_order_release);
+			return true;
+		}
+		
+		// retry later if all of the missing entries are being computed by other threads
+		if (p.claimed.empty()) {
+			queues.defer(i, task);
+			return false;
+		}
+		queues.push(i, task);
+		for (unsigned j = 0; j < p.claimed.size(); j++) queues.push(i, p.claimed[j]);
+		return true;
+	}
+	
+	void solve()
+	{
+		Set V = Set::complete(N);
+		Task root = { F, Set::empty(N).bits, V.bits, 0, 0, Semiring::zero(), Set::empty(N), Set::empty(N), Set::empty(N) };
+		std::atomic<unsigned char> &done = states[F]->at(root.x, root.y);
+		
+		done.store(CLAIMED);
+		STAT_MISS(STAT_F);
+		queues.push(0, root);
+		
+		ThreadPool pool(opt_threads);
+		pool.run(pool.size(), [&](size_t i) {
+			Task task;
+			while (done.load(std::memory_order_acquire) != DONE) {
+				if (!queues.pop(i, task) || !execute(i, task)) std::this_thread::yield();
+			}
+		});
+	}
+};
+
+template <typename Semiring>
+void solve_tables(TableSet<Semiring> &tables)
+{
+	ParallelSolver<Semiring> solver(tables);
+	solver.solve();
+}
+
+
+
+// Resets the entries that depend on the local score of X to zero, so that
+// MemoTables computes them again on demand. An entry of f, g or h for (x,y)
+// only depends on the scores of the subsets of x u y. Returns the number of
+// entries reset.
+template <typename Semiring>
+long long unsigned invalidate_tables(TableSet<Semiring> &tables, Set X)
+{
+	typename TableSet<Semiring>::Array *arrays[3] = { tables.f_values, tables.g_values, tables.h_values };
+	typename Semiring::value zero = Semiring::zero();
+	long long unsigned reset = 0;
+	
+	for (range_iterator<Set> ut(N, X, Set::complete(N)); ut.has_next(); ++ut) {
+		Set U = ut.set();
+		for (range_k_iterator<Set> xt(N, W, Set::empty(N), U); xt.has_next(); ++xt) {
+			Set x = xt.set();
+			Set y = U ^ x;
+			for (unsigned i = 0; i < 3; i++) {
+				if (arrays[i]->get(x.bits, y.bits) == zero) continue;
+				arrays[i]->set(x.bits, y.bits, zero);
+				reset++;
+			}
+		}
+	}
+	
+	return reset;
+}
+
+
+
+// Computes f(Ø,V) by the method given by the options, unless the tables were
+// loaded from a file (in which case any missing entries are computed on
+// demand), and saves the tables if requested.
+template <typename Semiring>
+typename Semiring::value compute_tables(MemoTables<Semiring> &tables)
+{
+	STAT_PHASE(PHASE_DP);
+	if (opt_load_tables == NULL) {
+		if (opt_bottom_up) fill_tables(tables);
+		else if (opt_threads > 1) solve_tables(tables);
+	}
+	
+	typename Semiring::value value = tables.f(Set::empty(N), Set::complete(N));
+	
+	if (opt_save_tables != NULL && opt_load_tables == NULL) {
+		save_tables(opt_save_tables, Semiring::name(), tables.f_values, tables.g_values, tables.h_values);
+	}
+	
+	STAT_PHASE(PHASE_SEARCH);
+	return value;
+}
+
+
+#endif
@@ -0,0 +1,341 @@
+/*
+ *  Adjunct
+ *  
+ *  Copyright 2015 Kustaa Kangas <jwkangas(at)cs.helsinki.fi>
+ *  
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *  
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *  
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <cstring>
+#include <cmath>
+#include <immintrin.h>
+
+#include "logsumexp.hpp"
+
+
+// The SIMD kernels compute exp(v) for v = x - max <= 0 as 2^k p(r), where
+// k = round(v / ln 2), r = v - k ln 2 is in [-ln(2)/2, ln(2)/2] and p is the
+// Taylor polynomial of exp of the given degree. The truncation error of p
+// relative to exp(r) is at most e^(2|r|) |r|^(d+1) / (d+1)!, which is
+// 8e-18 for degree 13 (below the rounding errors, a few ulps in all) and
+// 1.1e-8 for degree 7 (the fast mode, at most 2e-8 with the rounding).
+// Since all terms are positive, the relative error of a sum, and so the
+// absolute error of its log, is at most that of the terms. Each table entry
+// adds its own error to those of the entries it depends on, so an entry is
+// off by at most 3N times the bound (see single_precision_error()).
+// Terms with v < -708, whose exp would be subnormal, are taken as zero;
+// relative to the largest term they are below 1e-307.
+//
+// All kernels give the same bits, so that the tables and the samples drawn
+// for a seed do not depend on the processor: the terms are computed by the
+// same operations with fused multiply-adds (std::fma is correctly rounded
+// like the instruction), term i is added to lane i mod 8, and the lanes are
+// added up in the fixed order of reduce_lanes. LogSumExp rescales its sum
+// and takes its log by exp_portable and log_portable, likewise built from
+// correctly rounded operations only. Only the scalar mode, which calls exp()
+// and log(), depends on the C library (whose variants differ by processor).
+#define EXACT_DEGREE 13
+#define FAST_DEGREE 7
+
+static const double LOG2E = 1.4426950408889634;
+static const double LN2_HI = 0.6931471805599453;
+static const double LN2_LO = 2.3190468138462996e-17;
+static const double SHIFTER = 6755399441055744.0;  // 1.5 * 2^52
+static const double MIN_EXPONENT = -708.0;
+
+static const double SQRT2 = 1.4142135623730951;
+
+#define LOG_TERMS 12
+static const double inverse_odd[LOG_TERMS] = {
+	1.0, 1.0 / 3, 1.0 / 5, 1.0 / 7, 1.0 / 9, 1.0 / 11, 1.0 / 13, 1.0 / 15, 1.0 / 17, 1.0 / 19,
+	1.0 / 21, 1.0 / 23
+};
+
+static const double inverse_factorial[EXACT_DEGREE + 1] = {
+	1.0, 1.0, 1.0 / 2, 1.0 / 6, 1.0 / 24, 1.0 / 120, 1.0 / 720, 1.0 / 5040, 1.0 / 40320,
+	1.0 / 362880, 1.0 / 3628800, 1.0 / 39916800, 1.0 / 479001600, 1.0 / 6227020800.0
+};
+
+
+#define LANES 8
+
+static double reduce_lanes(const double *lanes)
+{
+	return ((lanes[0] + lanes[1]) + (lanes[2] + lanes[3])) + ((lanes[4] + lanes[5]) + (lanes[6] + lanes[7]));
+}
+
+// exp(v) for MIN_EXPONENT <= v <= 0, as computed in each lane of the kernels
+template <int DEGREE>
+static double exp_term(double v)
+{
+	double t = std::fma(v, LOG2E, SHIFTER);
+	double k = t - SHIFTER;
+	double r = std::fma(-k, LN2_HI, v);
+	r = std::fma(-k, LN2_LO, r);
+	
+	double p = inverse_factorial[DEGREE];
+	for (int d = DEGREE - 1; d >= 0; d--) p = std::fma(p, r, inverse_factorial[d]);
+	
+	// 2^k from the exponent bits
+	long long unsigned bits;
+	memcpy(&bits, &t, sizeof(bits));
+	bits = (bits << 52) + (1023ull << 52);
+	double scale;
+	memcpy(&scale, &bits, sizeof(scale));
+	return p * scale;
+}
+
+// adds the terms from i on to their lanes
+template <int DEGREE>
+static void add_terms(const double *x, unsigned i, unsigned n, double max, double *lanes)
+{
+	for (; i < n; i++) {
+		double v = x[i] - max;
+		if (v >= MIN_EXPONENT) lanes[i % LANES] += exp_term<DEGREE>(v);
+	}
+}
+
+// the kernels without SIMD, for processors without AVX2 and FMA
+template <int DEGREE>
+double sum_exp_portable(const double *x, unsigned n, double max)
+{
+	double lanes[LANES] = { 0 };
+	add_terms<DEGREE>(x, 0, n, max, lanes);
+	return reduce_lanes(lanes);
+}
+
+double sum_exp_scalar(const double *x, unsigned n, double max)
+{
+	double sum = 0;
+	for (unsigned i = 0; i < n; i++) sum += exp(x[i] - max);
+	return sum;
+}
+
+// exp(v) for v <= 0 by the kernel of the exact mode, zero below MIN_EXPONENT
+double exp_portable(double v)
+{
+	return v >= MIN_EXPONENT ? exp_term<EXACT_DEGREE>(v) : 0;
+}
+
+// Returns log(x) for a normal x > 0. With x = 2^e m for m in [sqrt(1/2),
+// sqrt(2)), log(m) = 2 atanh(s) for s = (m - 1) / (m + 1), |s| <= 0.172,
+// which is 2 (s + s^3/3 + ... + s^23/23) to within 1e-19 relative to log(m).
+double log_portable(double x)
+{
+	long long unsigned bits;
+	memcpy(&bits, &x, sizeof(bits));
+	double e = (double)(long long)(bits >> 52) - 1023;
+	bits = (bits & ((1ull << 52) - 1)) | (1023ull << 52);
+	double m;
+	memcpy(&m, &bits, sizeof(m));
+	if (m > SQRT2) {
+		m *= 0.5;
+		e += 1;
+	}
+	
+	double s = (m - 1) / (m + 1);
+	double s2 = s * s;
+	double p = inverse_odd[LOG_TERMS - 1];
+	for (int d = LOG_TERMS - 2; d >= 0; d--) p = std::fma(p, s2, inverse_odd[d]);
+	
+	return std::fma(e, LN2_HI, std::fma(e, LN2_LO, 2 * s * p));
+}
+
+double exp_scalar(double v)
+{
+	return exp(v);
+}
+
+double log_scalar(double x)
+{
+	return log(x);
+}
+
+double max_value_scalar(const double *x, unsigned n)
+{
+	double max = -INFTY;
+	for (unsigned i = 0; i < n; i++) {
+		if (x[i] > max) max = x[i];
+	}
+	return max;
+}
+
+
+// the terms of x[i..i+3] in the lanes of a vector, zero for v < MIN_EXPONENT
+template <int DEGREE>
+__attribute__((target("avx2,fma")))
+static __m256d exp_terms_avx2(const double *x, __m256d m)
+{
+	__m256d v = _mm256_sub_pd(_mm256_loadu_pd(x), m);
+	__m256d keep = _mm256_cmp_pd(v, _mm256_set1_pd(MIN_EXPONENT), _CMP_GE_OQ);
+	v = _mm256_max_pd(v, _mm256_set1_pd(MIN_EXPONENT));
+	
+	// k is rounded in the low bits of t
+	__m256d t = _mm256_fmadd_pd(v, _mm256_set1_pd(LOG2E), _mm256_set1_pd(SHIFTER));
+	__m256d k = _mm256_sub_pd(t, _mm256_set1_pd(SHIFTER));
+	__m256d r = _mm256_fnmadd_pd(k, _mm256_set1_pd(LN2_HI), v);
+	r = _mm256_fnmadd_pd(k, _mm256_set1_pd(LN2_LO), r);
+	
+	__m256d p = _mm256_set1_pd(inverse_factorial[DEGREE]);
+	for (int d = DEGREE - 1; d >= 0; d--) p = _mm256_fmadd_pd(p, r, _mm256_set1_pd(inverse_factorial[d]));
+	
+	// 2^k from the exponent bits
+	__m256i e = _mm256_slli_epi64(_mm256_castpd_si256(t), 52);
+	e = _mm256_add_epi64(e, _mm256_set1_epi64x(1023ll << 52));
+	p = _mm256_mul_pd(p, _mm256_castsi256_pd(e));
+	
+	return _mm256_and_pd(keep, p);
+}
+
+// eight lanes in two vectors, as in the other kernels
+template <int DEGREE>
+__attribute__((target("avx2,fma")))
+double sum_exp_avx2(const double *x, unsigned n, double max)
+{
+	__m256d m = _mm256_set1_pd(max);
+	__m256d low = _mm256_setzero_pd(), high = _mm256_setzero_pd();
+	
+	unsigned i = 0;
+	for (; i + LANES <= n; i += LANES) {
+		low = _mm256_add_pd(low, exp_terms_avx2<DEGREE>(x + i, m));
+		high = _mm256_add_pd(high, exp_terms_avx2<DEGREE>(x + i + 4, m));
+	}
+	
+	double lanes[LANES];
+	_mm256_storeu_pd(lanes, low);
+	_mm256_storeu_pd(lanes + 4, high);
+	add_terms<DEGREE>(x, i, n, max, lanes);
+	return reduce_lanes(lanes);
+}
+
+__attribute__((target("avx2")))
+double max_value_avx2(const double *x, unsigned n)
+{
+	__m256d max = _mm256_set1_pd(-INFTY);
+	
+	unsigned i = 0;
+	for (; i + 4 <= n; i += 4) max = _mm256_max_pd(max, _mm256_loadu_pd(x + i));
+	
+	double lanes[4];
+	_mm256_storeu_pd(lanes, max);
+	double m = max_value_scalar(x + i, n - i);
+	for (unsigned j = 0; j < 4; j++) {
+		if (lanes[j] > m) m = lanes[j];
+	}
+	return m;
+}
+
+
+// the AVX-512 intrinsics of some versions of GCC trigger false warnings
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wuninitialized"
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+
+template <int DEGREE>
+__attribute__((target("avx512f")))
+double sum_exp_avx512(const double *x, unsigned n, double max)
+{
+	__m512d m = _mm512_set1_pd(max);
+	__m512d sum = _mm512_setzero_pd();
+	
+	for (unsigned i = 0; i < n; i += 8) {
+		__mmask8 lanes = n - i >= 8 ? 0xff : (1 << (n - i)) - 1;
+		__m512d v = _mm512_sub_pd(_mm512_maskz_loadu_pd(lanes, x + i), m);
+		lanes &= _mm512_cmp_pd_mask(v, _mm512_set1_pd(MIN_EXPONENT), _CMP_GE_OQ);
+		v = _mm512_max_pd(v, _mm512_set1_pd(MIN_EXPONENT));
+		
+		// k is rounded in the low bits of t
+		__m512d t = _mm512_fmadd_pd(v, _mm512_set1_pd(LOG2E), _mm512_set1_pd(SHIFTER));
+		__m512d k = _mm512_sub_pd(t, _mm512_set1_pd(SHIFTER));
+		__m512d r = _mm512_fnmadd_pd(k, _mm512_set1_pd(LN2_HI), v);
+		r = _mm512_fnmadd_pd(k, _mm512_set1_pd(LN2_LO), r);
+		
+		__m512d p = _mm512_set1_pd(inverse_factorial[DEGREE]);
+		for (int d = DEGREE - 1; d >= 0; d--) p = _mm512_fmadd_pd(p, r, _mm512_set1_pd(inverse_factorial[d]));
+		
+		// 2^k from the exponent bits
+		__m512i e = _mm512_slli_epi64(_mm512_castpd_si512(t), 52);
+		e = _mm512_add_epi64(e, _mm512_set1_epi64(1023ll << 52));
+		p = _mm512_mul_pd(p, _mm512_castsi512_pd(e));
+		
+		sum = _mm512_mask_add_pd(sum, lanes, sum, p);
+	}
+	
+	double total[LANES];
+	_mm512_storeu_pd(total, sum);
+	return reduce_lanes(total);
+}
+
+__attribute__((target("avx512f")))
+double max_value_avx512(const double *x, unsigned n)
+{
+	__m512d max = _mm512_set1_pd(-INFTY);
+	
+	for (unsigned i = 0; i < n; i += 8) {
+		__mmask8 lanes = n - i >= 8 ? 0xff : (1 << (n - i)) - 1;
+		max = _mm512_mask_max_pd(max, lanes, max, _mm512_maskz_loadu_pd(lanes, x + i));
+	}
+	
+	return _mm512_reduce_max_pd(max);
+}
+
+#pragma GCC diagnostic pop
+
+
+double (*sum_exp)(const double *x, unsigned n, double max) = sum_exp_scalar;
+double (*max_value)(const double *x, unsigned n) = max_value_scalar;
+double (*scale_exp)(double v) = exp_scalar;
+double (*sum_log)(double x) = log_scalar;
+const char *logsumexp_implementation = "scalar";
+const char *logsumexp_mode_name = "scalar";
+
+int select_logsumexp(const char *mode)
+{
+	bool fast = !strcmp(mode, "fast");
+	bool simd = fast || !strcmp(mode, "exact");
+	if (!simd && strcmp(mode, "scalar")) return 0;
+	
+	if (simd && __builtin_cpu_supports("avx512f")) {
+		sum_exp = fast ? sum_exp_avx512<FAST_DEGREE> : sum_exp_avx512<EXACT_DEGREE>;
+		max_value = max_value_avx512;
+		logsumexp_implementation = fast ? "AVX-512, fast" : "AVX-512";
+	} else if (simd && __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+		sum_exp = fast ? sum_exp_avx2<FAST_DEGREE> : sum_exp_avx2<EXACT_DEGREE>;
+		max_value = max_value_avx2;
+		logsumexp_implementation = fast ? "AVX2, fast" : "AVX2";
+	} else if (simd) {
+		sum_exp = fast ? sum_exp_portable<FAST_DEGREE> : sum_exp_portable<EXACT_DEGREE>;
+		max_value = max_value_scalar;
+		logsumexp_implementation = fast ? "portable, fast" : "portable";
+	} else {
+		sum_exp = sum_exp_scalar;
+		max_value = max_value_scalar;
+		logsumexp_implementation = "scalar";
+	}
+	scale_exp = simd ? exp_portable : exp_scalar;
+	sum_log = simd ? log_portable : log_scalar;
+	logsumexp_mode_name = fast ? "fast" : simd ? "exact" : "scalar";
+	return 1;
+}
+
+const char *logsumexp_name()
+{
+	return logsumexp_implementation;
+}
+
+const char *logsumexp_mode()
+{
+	return logsumexp_mode_name;
+}
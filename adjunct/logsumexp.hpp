@@ -0,0 +1,95 @@
+/*
+ *  Adjunct
+ *  
+ *  Copyright 2015 Kustaa Kangas <jwkangas(at)cs.helsinki.fi>
+ *  
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *  
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *  
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef LOGSUMEXP_HPP
+#define LOGSUMEXP_HPP
+
+#include <cmath>
+
+#include "tools.hpp"
+
+
+// Returns the sum of exp(x[i] - max) over i < n, for max at least each x[i].
+// The implementation is chosen at startup by select_logsumexp(): AVX-512 or
+// AVX2 if the processor has them, else a scalar loop calling exp().
+extern double (*sum_exp)(const double *x, unsigned n, double max);
+
+// returns the maximum of x[i] over i < n, -INFTY if n is 0
+extern double (*max_value)(const double *x, unsigned n);
+
+// exp(v) for v <= 0 and log(x) for x >= 1, by which LogSumExp rescales its
+// sum and ends it: in the exact and fast modes by the same operations on
+// every processor (see logsumexp.cpp), in the scalar mode by exp() and log()
+extern double (*scale_exp)(double v);
+extern double (*sum_log)(double x);
+
+// Selects the implementation: "exact" (the default) evaluates exp to within a
+// few ulps, "fast" to a relative error of at most 2e-8 per term (see
+// logsumexp.cpp), and "scalar" calls exp() without SIMD. The exact and fast
+// modes give the same bits with or without SIMD, on any processor, also in
+// the rescaling and the log of LogSumExp. Returns 0 for an unknown mode.
+int select_logsumexp(const char *mode);
+
+// the implementation in use, e.g. "AVX2, fast", and the mode selected
+const char *logsumexp_name();
+const char *logsumexp_mode();
+
+
+// Adds up numbers in log space, like logsum() term by term, but gathering the
+// terms in blocks: the sum of a block is taken relative to its maximum by one
+// call to sum_exp, and the log is taken once at the end.
+struct LogSumExp
+{
+	static const unsigned BLOCK = 64;
+	
+	double terms[BLOCK];
+	unsigned n;
+	
+	// the terms flushed so far add up to max + log(sum)
+	double max, sum;
+	
+	LogSumExp() : n(0), max(-INFTY), sum(0) {}
+	
+	void add(double term)
+	{
+		terms[n++] = term;
+		if (n == BLOCK) flush();
+	}
+	
+	void flush()
+	{
+		double block_max = max_value(terms, n);
+		if (block_max > max) {
+			sum *= scale_exp(max - block_max);
+			max = block_max;
+		}
+		if (block_max != -INFTY) sum += sum_exp(terms, n, max);
+		n = 0;
+	}
+	
+	double value()
+	{
+		flush();
+		return max == -INFTY ? -INFTY : max + sum_log(sum);
+	}
+};
+
+
+#endif
@@ -17,176 +17,609 @@
  *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
-#include "common.hpp"
+#include <algorithm>
 
+#include "kernel.hpp"
 
-#define FLOAT_EQUALS(a, b) (fabs((a) - (b)) <= 0.000001)
+
+#define EPSILON 0.000001
+#define FLOAT_EQUALS(a, b) (fabs((a) - (b)) <= EPSILON)
 // #define FLOAT_EQUALS(a, b) ((a) == (b))
 
 
-double compute_max_f(Set S, Set R);
-double compute_max_g(Set C, Set U);
-double compute_max_h(Set C, Set R);
+typedef Recurrence<MaxSemiring> Max;
+typedef MaxTables::ArgArray ArgArray;
+
+// the maximizing choices of the entries if they are recorded (-a)
+ArgArray *f_args = NULL, *g_args = NULL, *h_args = NULL;
+
+TreeNode<Set> *backtrack_max_f(MaxTables &t, Set S, Set R, double score_m, TreeNode<Set> *node);
+void backtrack_max_g(MaxTables &t, Set C, Set U, double score_m, TreeNode<Set> *node);
+void backtrack_max_h(MaxTables &t, Set C, Set R, double score_m, TreeNode<Set> *node);
 
-TreeNode<Set> *backtrack_max_f(Set S, Set R, double score_m, TreeNode<Set> *node);
-void backtrack_max_g(Set C, Set U, double score_m, TreeNode<Set> *node);
-void backtrack_max_h(Set C, Set R, double score_m, TreeNode<Set> *node);
 
 
+// Backtracking follows the first term that reaches the score of each entry.
+// With tables stored in single precision the terms may miss the rounded
+// score, so then it follows the largest term, recomputed in double.
 
-double compute_max_h(Set C, Set R)
+void backtrack_max_h(MaxTables &t, Set C, Set R, double score_m, TreeNode<Set> *node)
 {
-	double cached = h_values->get(C.bits, R.bits);
-	if (cached != -INFTY) return cached;
+	Set best = Set::empty(N);
+	double best_score = -INFTY;
 	
-	double max_score = -INFTY;
-	
-	H_ITERATE(it) {
+	for (h_iterator it(C); it.has_next(); ++it) {
 		Set S = it.set();
 		
-		double score_s = local_score(S);
-		double score_f = compute_max_f(S, R);
-		double score = score_f - score_s;
+		double score = Max::h_term(t, S, R);
 		
-		if (score > max_score) max_score = score;
+		if FLOAT_EQUALS(score, score_m) {
+			backtrack_max_f(t, S, R, t.f(S, R), node);
+			return;
+		}
+		if (score > best_score) {
+			best = S;
+			best_score = score;
+		}
 	}
 	
-	h_values->set(C.bits, R.bits, max_score);
-	return max_score;
+	assert(opt_single_precision);
+	backtrack_max_f(t, best, R, t.f(best, R), node);
 }
 
 
-double compute_max_g(Set C, Set U)
+void backtrack_max_g(MaxTables &t, Set C, Set U, double score_m, TreeNode<Set> *node)
 {
-	double cached = g_values->get(C.bits, U.bits);
-	if (cached != -INFTY) return cached;
-	
-	if (U.is_empty()) {
-		g_values->set(C.bits, U.bits, 0.0);
-		return 0.0;
-	}
+	if (U.is_empty()) return;
 	
-	double max_score = -INFTY;
+	Set best = Set::empty(N);
+	double best_score = -INFTY;
 	
-	G_ITERATE(it) {
+	for (g_iterator it(U); it.has_next(); ++it) {
 		Set R = it.set();
 		
-		double score_h = compute_max_h(C, R);
-		double score_g = compute_max_g(C, U ^ R);
-		double score = score_h + score_g;
+		double score = Max::g_term(t, C, U, R);
 		
-		if (score > max_score) max_score = score;
+		if FLOAT_EQUALS(score, score_m) {
+			backtrack_max_h(t, C, R, t.h(C, R), node);
+			backtrack_max_g(t, C, U ^ R, t.g(C, U ^ R), node);
+			return;
+		}
+		if (score > best_score) {
+			best = R;
+			best_score = score;
+		}
 	}
 	
-	g_values->set(C.bits, U.bits, max_score);
-	return max_score;
+	assert(opt_single_precision);
+	backtrack_max_h(t, C, best, t.h(C, best), node);
+	backtrack_max_g(t, C, U ^ best, t.g(C, U ^ best), node);
 }
 
 
-double compute_max_f(Set S, Set R)
+TreeNode<Set> *backtrack_max_f(MaxTables &t, Set S, Set R, double score_m, TreeNode<Set> *node)
 {
-	double cached = f_values->get(S.bits, R.bits);
-	if (cached != -INFTY) return cached;
-	
-	double max_score = -INFTY;
+	Set best = Set::empty(N);
+	double best_score = -INFTY;
+	bool reached = false;
 	
-	F_ITERATE_OPT(it) {
+	for (f_iterator it(S, R, MaxSemiring::fix_first); it.has_next() && !reached; ++it) {
 		Set D = it.set();
-		Set C = S | D;
 		
-		double score_c = local_score(C);
-		double score_g = compute_max_g(C, R ^ D);
-		double score = score_c + score_g;
+		double score = Max::f_term(t, S, R, D);
 		
-		if (score > max_score) max_score = score;
+		reached = FLOAT_EQUALS(score, score_m);
+		if (reached || score > best_score) {
+			best = D;
+			best_score = score;
+		}
 	}
 	
-	f_values->set(S.bits, R.bits, max_score);
-	return max_score;
+	assert(reached || opt_single_precision);
+	Set C = S | best;
+	TreeNode<Set> *child = new TreeNode<Set>(C, S);
+	if (node != NULL) node->add(child);
+	backtrack_max_g(t, C, R ^ best, t.g(C, R ^ best), child);
+	return child;
 }
 
 
+// Backtracking along the recorded choices visits one entry per term of the
+// optimal RPT, and it needs no comparison of scores.
 
+TreeNode<Set> *backtrack_arg_f(Set S, Set R, TreeNode<Set> *node);
 
-void backtrack_max_h(Set C, Set R, double score_m, TreeNode<Set> *node)
+void backtrack_arg_h(Set C, Set R, TreeNode<Set> *node)
 {
-	H_ITERATE(it) {
-		Set S = it.set();
-		
-		double score_s = local_score(S);
-		double score_f = compute_max_f(S, R);
-		double score = score_f - score_s;
-		
-		if FLOAT_EQUALS(score, score_m) {
-			backtrack_max_f(S, R, score_f, node);
-			return;
-		}
-	}
+	backtrack_arg_f(h_args->get(C.bits, R.bits), R, node);
+}
+
+void backtrack_arg_g(Set C, Set U, TreeNode<Set> *node)
+{
+	if (U.is_empty()) return;
+	
+	Set R = g_args->get(C.bits, U.bits);
+	backtrack_arg_h(C, R, node);
+	backtrack_arg_g(C, U ^ R, node);
+}
+
+TreeNode<Set> *backtrack_arg_f(Set S, Set R, TreeNode<Set> *node)
+{
+	Set D = f_args->get(S.bits, R.bits);
+	Set C = S | D;
 	
-	assert(0);
+	TreeNode<Set> *child = new TreeNode<Set>(C, S);
+	if (node != NULL) node->add(child);
+	backtrack_arg_g(C, R ^ D, child);
+	return child;
 }
 
 
-void backtrack_max_g(Set C, Set U, double score_m, TreeNode<Set> *node)
+
+// Branch and bound for the max recurrences. Each variable v enters an RPT in
+// exactly one clique C, where it is not in the separator S of C. Adding the
+// elements of C \ S to S one at a time splits p(C) / p(S) into terms
+// p(P u v) / p(P) with |P| < W, so each of them is at most
+//
+//   best(v) = max over P not containing v, |P| < W  of  p(P u v) / p(P)
+//
+// and, with b(X) the product of best(v) over v in X,
+//
+//   f(S,R) <= p(S) b(R),  g(C,U) <= b(U),  h(C,R) <= b(R).
+//
+// An entry is evaluated with a threshold below which its exact value is not
+// needed. Choices whose bound is below the best value found so far (or the
+// threshold) are skipped, and the thresholds of the subproblems are derived
+// from it. If the entry turns out to be below its threshold, only an upper
+// bound below the threshold is stored, marked as such, and it is computed
+// again if it is later needed with a lower threshold. The threshold of f(Ø,V)
+// comes from an incumbent RPT whose score the optimum is known to reach.
+struct BranchAndBound
 {
-	if (U.is_empty()) return;
+	enum { UNKNOWN = 0, EXACT, BOUND };
 	
-	G_ITERATE(it) {
-		Set R = it.set();
+	typedef DisjointPairArray<unsigned char> StateArray;
+	
+	// a value and whether it is exact or only an upper bound
+	struct Value
+	{
+		double value;
+		bool exact;
+	};
+	
+	StateArray *f_states, *g_states, *h_states;
+	
+	// b(X) of each byte value of each byte of the sets X, whose sums over the
+	// bytes of X give b(X) without a table of all sets
+	double byte_bounds[sizeof(set_word)][256];
+	
+	// number of entries evaluated
+	unsigned long long evaluated;
+	
+	BranchAndBound() : evaluated(0)
+	{
+		f_states = new StateArray(N, W, UNKNOWN, ALLOCATE_LAZY);
+		g_states = new StateArray(N, W, UNKNOWN, ALLOCATE_LAZY);
+		h_states = new StateArray(N, W, UNKNOWN, ALLOCATE_LAZY);
 		
-		double score_h = compute_max_h(C, R);
-		double score_g = compute_max_g(C, U ^ R);
-		double score = score_h + score_g;
+		double best[8 * sizeof(set_word)];
+		for (unsigned v = 0; v < 8 * sizeof(set_word); v++) best[v] = v < N ? -INFTY : 0;
 		
-		if FLOAT_EQUALS(score, score_m) {
-			backtrack_max_h(C, R, score_h, node);
-			backtrack_max_g(C, U ^ R, score_g, node);
-			return;
+		for (range_k_iterator<Set> it(N, W, Set::empty(N), Set::complete(N)); it.has_next(); ++it) {
+			Set X = it.set();
+			for (unsigned v = 0; v < N; v++) {
+				if (!X.has(v)) continue;
+				double gain = local_score(X) - local_score((X ^ v));
+				if (gain > best[v]) best[v] = gain;
+			}
+		}
+		
+		for (unsigned i = 0; i < sizeof(set_word); i++) {
+			byte_bounds[i][0] = 0;
+			for (unsigned x = 1; x < 256; x++) {
+				byte_bounds[i][x] = byte_bounds[i][x & (x - 1)] + best[8 * i + Set(x).first(8)];
+			}
 		}
 	}
 	
-	assert(0);
-}
+	~BranchAndBound()
+	{
+		delete f_states;
+		delete g_states;
+		delete h_states;
+	}
+	
+	double bound(Set X) const
+	{
+		double b = 0;
+		for (unsigned i = 0; 8 * i < N; i++) b += byte_bounds[i][(X.bits >> (8 * i)) & 255];
+		return b;
+	}
+	
+	// returns a cached value if it is exact or a bound below the threshold
+	static bool cached(SetArray *values, StateArray *states, Set X, Set Y, double threshold, Value &v)
+	{
+		unsigned char state = states->get(X.bits, Y.bits);
+		if (state == UNKNOWN) return false;
+		
+		v.value = values->get(X.bits, Y.bits);
+		v.exact = state == EXACT;
+		return v.exact || v.value < threshold;
+	}
+	
+	// stores the maximum (and its choice arg, if recorded) if it reaches the
+	// threshold (and thus every term that was not computed exactly is below
+	// it), or otherwise an upper bound below the threshold
+	static Value store(SetArray *values, StateArray *states, ArgArray *args, Set X, Set Y,
+		double threshold, double max, Set arg, double max_bound)
+	{
+		Value v;
+		v.exact = max >= threshold;
+		v.value = v.exact || max > max_bound ? max : max_bound;
+		
+		values->set(X.bits, Y.bits, v.value);
+		states->set(X.bits, Y.bits, v.exact ? EXACT : BOUND);
+		if (v.exact) MaxTables::record(args, X, Y, arg);
+		return v;
+	}
+	
+	static Value upper(double value)
+	{
+		Value v = { value, false };
+		return v;
+	}
+	
+	Value h(Set C, Set R, double threshold)
+	{
+		Value v;
+		if (cached(h_values, h_states, C, R, threshold, v)) {
+			STAT_HIT(STAT_H);
+			return v;
+		}
+		if (bound(R) < threshold) return upper(bound(R));
+		evaluated++;
+		STAT_MISS(STAT_H);
+		
+		double max = -INFTY, max_bound = -INFTY;
+		Set arg = Set::empty(N);
+		
+		for (h_iterator it(C); it.has_next(); ++it) {
+			STAT_TERM(STAT_H);
+			Set S = it.set();
+			double lower = max > threshold ? max : threshold;
+			
+			Value x = f(S, R, lower + local_score(S));
+			double score = x.value - local_score(S);
+			
+			if (!x.exact) {
+				if (score > max_bound) max_bound = score;
+			} else if (score > max) {
+				max = score;
+				arg = S;
+			}
+		}
+		
+		return store(h_values, h_states, h_args, C, R, threshold, max, arg, max_bound);
+	}
+	
+	Value g(Set C, Set U, double threshold)
+	{
+		if (U.is_empty()) {
+			Value v = { 0.0, true };
+			return v;
+		}
+		
+		Value v;
+		if (cached(g_values, g_states, C, U, threshold, v)) {
+			STAT_HIT(STAT_G);
+			return v;
+		}
+		if (bound(U) < threshold) return upper(bound(U));
+		evaluated++;
+		STAT_MISS(STAT_G);
+		
+		double max = -INFTY, max_bound = -INFTY;
+		Set arg = Set::empty(N);
+		
+		for (g_iterator it(U); it.has_next(); ++it) {
+			STAT_TERM(STAT_G);
+			Set R = it.set();
+			double lower = max > threshold ? max : threshold;
+			
+			Value x = h(C, R, lower - bound(U ^ R));
+			if (!x.exact) {
+				double score = x.value + bound(U ^ R);
+				if (score > max_bound) max_bound = score;
+				continue;
+			}
+			
+			Value y = g(C, U ^ R, lower - x.value);
+			double score = x.value + y.value;
+			
+			if (!y.exact) {
+				if (score > max_bound) max_bound = score;
+			} else if (score > max) {
+				max = score;
+				arg = R;
+			}
+		}
+		
+		return store(g_values, g_states, g_args, C, U, threshold, max, arg, max_bound);
+	}
+	
+	Value f(Set S, Set R, double threshold)
+	{
+		Value v;
+		if (cached(f_values, f_states, S, R, threshold, v)) {
+			STAT_HIT(STAT_F);
+			return v;
+		}
+		if (local_score(S) + bound(R) < threshold) return upper(local_score(S) + bound(R));
+		evaluated++;
+		STAT_MISS(STAT_F);
+		
+		double max = -INFTY, max_bound = -INFTY;
+		Set arg = Set::empty(N);
+		
+		for (f_iterator it(S, R, MaxSemiring::fix_first); it.has_next(); ++it) {
+			STAT_TERM(STAT_F);
+			Set D = it.set();
+			Set C = S | D;
+			double lower = max > threshold ? max : threshold;
+			
+			// skip cliques that cannot reach the lower limit
+			double score = local_score(C) + bound(R ^ D);
+			if (score < lower) {
+				if (score > max_bound) max_bound = score;
+				continue;
+			}
+			
+			Value x = g(C, R ^ D, lower - local_score(C));
+			score = local_score(C) + x.value;
+			
+			if (!x.exact) {
+				if (score > max_bound) max_bound = score;
+			} else if (score > max) {
+				max = score;
+				arg = D;
+			}
+		}
+		
+		return store(f_values, f_states, f_args, S, R, threshold, max, arg, max_bound);
+	}
+	
+	
+	// backtracking follows the terms that reach the score of each entry,
+	// which are always evaluated exactly with a threshold just below it
+	
+	void backtrack_h(Set C, Set R, double score_m, TreeNode<Set> *node)
+	{
+		for (h_iterator it(C); it.has_next(); ++it) {
+			Set S = it.set();
+			
+			Value x = f(S, R, score_m + local_score(S) - EPSILON);
+			
+			if (x.exact && FLOAT_EQUALS(x.value - local_score(S), score_m)) {
+				backtrack_f(S, R, x.value, node);
+				return;
+			}
+		}
+		
+		assert(0);
+	}
+	
+	void backtrack_g(Set C, Set U, double score_m, TreeNode<Set> *node)
+	{
+		if (U.is_empty()) return;
+		
+		for (g_iterator it(U); it.has_next(); ++it) {
+			Set R = it.set();
+			
+			Value x = h(C, R, score_m - bound(U ^ R) - EPSILON);
+			if (!x.exact) continue;
+			
+			Value y = g(C, U ^ R, score_m - x.value - EPSILON);
+			
+			if (y.exact && FLOAT_EQUALS(x.value + y.value, score_m)) {
+				backtrack_h(C, R, x.value, node);
+				backtrack_g(C, U ^ R, y.value, node);
+				return;
+			}
+		}
+		
+		assert(0);
+	}
+	
+	TreeNode<Set> *backtrack_f(Set S, Set R, double score_m, TreeNode<Set> *node)
+	{
+		for (f_iterator it(S, R, MaxSemiring::fix_first); it.has_next(); ++it) {
+			Set D = it.set();
+			Set C = S | D;
+			
+			if (local_score(C) + bound(R ^ D) < score_m - EPSILON) continue;
+			
+			Value x = g(C, R ^ D, score_m - local_score(C) - EPSILON);
+			
+			if (x.exact && FLOAT_EQUALS(local_score(C) + x.value, score_m)) {
+				TreeNode<Set> *child = new TreeNode<Set>(C, S);
+				if (node != NULL) node->add(child);
+				backtrack_g(C, R ^ D, x.value, child);
+				return child;
+			}
+		}
+		
+		assert(0);
+	}
+	
+	// Returns the value of f(Ø,V) for a greedy incumbent: the maximum spanning
+	// forest (Chow-Liu) under the gains p({u,v}) p(Ø) / p({u}) p({v}), keeping
+	// only positive gains. Its cliques are its edges and isolated vertices.
+	static double greedy_incumbent()
+	{
+		double score = local_score(Set::empty(N));
+		for (unsigned v = 0; v < N; v++) {
+			score += local_score((Set::empty(N) | v)) - local_score(Set::empty(N));
+		}
+		if (W < 2) return score;
+		
+		std::vector<std::pair<double, Set> > edges;
+		for (range_exact_iterator<Set> it(N, 2, Set::empty(N), Set::complete(N)); it.has_next(); ++it) {
+			Set E = it.set();
+			double gain = local_score(E) + local_score(Set::empty(N));
+			for (unsigned v = 0; v < N; v++) {
+				if (E.has(v)) gain -= local_score((Set::empty(N) | v));
+			}
+			if (gain > 0) edges.push_back(std::make_pair(gain, E));
+		}
+		std::sort(edges.begin(), edges.end(), [](const std::pair<double, Set> &a, const std::pair<double, Set> &b) {
+			return a.first > b.first;
+		});
+		
+		// components of the forest
+		unsigned component[MAX_SET_SIZE];
+		for (unsigned v = 0; v < N; v++) component[v] = v;
+		
+		for (unsigned i = 0; i < edges.size(); i++) {
+			Set E = edges[i].second;
+			unsigned u = E.first(N), v = (E ^ u).first(N);
+			unsigned cu = component[u], cv = component[v];
+			if (cu == cv) continue;
+			
+			for (unsigned x = 0; x < N; x++) {
+				if (component[x] == cv) component[x] = cu;
+			}
+			score += edges[i].first;
+		}
+		
+		return score;
+	}
+	
+	// returns the value of f(Ø,V) for an RPT in the compact form,
+	// or -INFTY if it is malformed, too wide or does not cover all variables
+	static double given_incumbent(const char *tree)
+	{
+		TreeNode<Set> *root = parse_tree(tree);
+		if (root == NULL) return -INFTY;
+		
+		double score = -INFTY;
+		if ((unsigned)root->width() <= W && root->variables() == Set::complete(N)) {
+			score = root->score() + local_score(Set::empty(N));
+		}
+		
+		delete root;
+		return score;
+	}
+};
 
 
-TreeNode<Set> *backtrack_max_f(Set S, Set R, double score_m, TreeNode<Set> *node)
+TreeNode<Set> *find_optimum_bounded()
 {
-	F_ITERATE_OPT(it) {
-		Set D = it.set();
-		Set C = S | D;
-		
-		double score_c = local_score(C);
-		double score_g = compute_max_g(C, R ^ D);
-		double score = score_c + score_g;
-		
-		if FLOAT_EQUALS(score, score_m) {
-			TreeNode<Set> *child = new TreeNode<Set>(C, S);
-			if (node != NULL) node->add(child);
-			backtrack_max_g(C, R ^ D, score_g, child);
-			return child;
+	BranchAndBound bb;
+	
+	double incumbent;
+	if (opt_incumbent != NULL) {
+		incumbent = BranchAndBound::given_incumbent(opt_incumbent);
+		if (incumbent == -INFTY) {
+			printf("Warning: The incumbent tree is malformed, wider than %u or does not cover all variables.\n", W);
 		}
+		vbprintf("Incumbent score: %f (given)\n", incumbent);
+	} else {
+		incumbent = BranchAndBound::greedy_incumbent();
+		vbprintf("Incumbent score: %f (greedy spanning forest)\n", incumbent);
+	}
+	
+	STAT_PHASE(PHASE_DP);
+	Set V = Set::complete(N);
+	BranchAndBound::Value max = bb.f(Set::empty(N), V, incumbent - EPSILON);
+	if (!max.exact) {
+		vbprintf("The incumbent was not reached, searching without it...\n");
+		max = bb.f(Set::empty(N), V, -INFTY);
+	}
+	
+	if (opt_verbose) {
+		unsigned char unknown = BranchAndBound::UNKNOWN;
+		vbprintf("Entries evaluated: %llu times, %llu distinct of %llu\n", bb.evaluated,
+			bb.f_states->filled(unknown) + bb.g_states->filled(unknown) +
+			bb.h_states->filled(unknown), 3 * SetArray::estimate(N, W));
 	}
 	
-	assert(0);
+	STAT_PHASE(PHASE_SEARCH);
+	vbprintf("Optimum found. Backtracking...\n");
+	if (opt_argmax) return backtrack_arg_f(Set::empty(N), V, (TreeNode<Set>*)NULL);
+	return bb.backtrack_f(Set::empty(N), V, max.value, (TreeNode<Set>*)NULL);
 }
 
 
-
-void find_global_optimum()
+// finds an optimal tree, freeing the tables
+TreeNode<Set> *find_optimum()
 {
-	allocate_tables();
+	// the bounds are compared with thresholds as they are stored
+	if (opt_branch_and_bound && opt_single_precision) {
+		vbprintf("Branch and bound keeps the tables in double precision.\n");
+		opt_single_precision = 0;
+	}
+	// loaded tables have neither the choices nor the bounds
+	if (opt_load_tables != NULL && (opt_argmax || opt_branch_and_bound)) {
+		vbprintf("Loaded tables are backtracked without -a and -p.\n");
+		opt_argmax = 0;
+		opt_branch_and_bound = 0;
+	}
+	
+	allocate_tables(MaxSemiring::name());
 	
 	vbprintf("\nComputing max tables...\n");
-	double max_score = compute_max_f(Set::empty(N), Set::complete(N));
 	
-	vbprintf("Optimum found. Backtracking...\n");
-	TreeNode<Set> *root = backtrack_max_f(Set::empty(N), Set::complete(N), max_score, (TreeNode<Set>*)NULL);
+	if (opt_argmax) {
+		RowAllocation allocation = table_allocation();
+		const char *dir = opt_scratch_directory;
+		f_args = new ArgArray(N, W, Set::empty(N), allocation, dir);
+		g_args = new ArgArray(N, W, Set::empty(N), allocation, dir);
+		h_args = new ArgArray(N, W, Set::empty(N), allocation, dir);
+	}
 	
-	root->output();
+	TreeNode<Set> *root;
+	if (opt_branch_and_bound) {
+		root = find_optimum_bounded();
+	} else {
+		MaxTables tables(f_values, g_values, h_values);
+		tables.f_args = f_args;
+		tables.g_args = g_args;
+		tables.h_args = h_args;
+		
+		double max_score = compute_tables(tables);
+		
+		if (opt_verbose) {
+			vbprintf("Entries computed: %llu of %llu\n", f_values->filled(-INFTY) +
+				g_values->filled(-INFTY) + h_values->filled(-INFTY),
+				3 * SetArray::estimate(N, W));
+		}
+		
+		vbprintf("Optimum found. Backtracking...\n");
+		if (opt_argmax) root = backtrack_arg_f(Set::empty(N), Set::complete(N), (TreeNode<Set>*)NULL);
+		else root = backtrack_max_f(tables, Set::empty(N), Set::complete(N), max_score, (TreeNode<Set>*)NULL);
+		
+		// the score of the tree is exact, the optimum is within the error of the tables
+		if (opt_single_precision) {
+			double error = single_precision_error();
+			double optimum = max_score - local_score(Set::empty(N));
+			vbprintf("Single precision: optimum %f +- %g, the tree is at most %g below it\n",
+				optimum, error, optimum + error - root->score());
+		}
+	}
 	
 	deallocate_tables();
+	delete f_args;
+	delete g_args;
+	delete h_args;
+	f_args = g_args = h_args = NULL;
 	
-	delete root;
+	return root;
 }
 
-
+void find_global_optimum()
+{
+	TreeNode<Set> *root = find_optimum();
+	STAT_PHASE(PHASE_OUTPUT);
+	root->output();
+	delete root;
+}
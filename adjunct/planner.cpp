@@ -0,0 +1,281 @@
+/*
+ *  Adjunct
+ *  
+ *  Copyright 2015 Kustaa Kangas <jwkangas(at)cs.helsinki.fi>
+ *  
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *  
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *  
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include <sys/statvfs.h>
+#include <unistd.h>
+#include <sys/vfs.h>
+
+#include "common.hpp"
+
+#define TMPFS_MAGIC 0x01021994
+
+
+// The memory that an action needs, item by item. An item is either exact or
+// an upper bound, for structures that are allocated as they are used.
+struct Footprint
+{
+	struct Item
+	{
+		const char *name;
+		unsigned long long bytes;
+		bool bound;
+	};
+	
+	std::vector<Item> items;
+	unsigned long long memory, disk;
+	
+	Footprint() : memory(0), disk(0) {}
+	
+	void add(const char *name, unsigned long long bytes, bool bound = false)
+	{
+		if (bytes == 0) return;
+		Item item = { name, bytes, bound };
+		items.push_back(item);
+		memory += bytes;
+	}
+	
+	static void print_bytes(unsigned long long bytes)
+	{
+		double m = bytes / 1024.0 / 1024.0;
+		if (m < 1000) printf("%10.2f M", m);
+		else printf("%10.2f G", m / 1024);
+	}
+	
+	void print()
+	{
+		for (unsigned i = 0; i < items.size(); i++) {
+			printf("  %-32s", items[i].name);
+			print_bytes(items[i].bytes);
+			printf("%s\n", items[i].bound ? " (at most)" : "");
+		}
+		printf("  %-32s", "total");
+		print_bytes(memory);
+		printf("\n");
+		if (disk > 0) {
+			printf("  %-32s", "scratch files");
+			print_bytes(disk);
+			printf("\n");
+		}
+	}
+};
+
+
+// the bytes of the transforms that subset convolution keeps for all cliques
+unsigned long long convolution_bytes(unsigned w, bool count)
+{
+	unsigned long long bytes = 0;
+	for (unsigned c = 1; c <= w && c < N; c++) {
+		unsigned long long m = N - c;
+		unsigned long long clique = 2 * (m + 1) * (1ull << m) * sizeof(long double) + m * sizeof(long double);
+		if (count) clique = 2 * (m + 1) * (1ull << m) * (sizeof(count_t) + sizeof(long double));
+		bytes += range_k_iterator<Set>::binom[N][c] * clique;
+	}
+	return bytes;
+}
+
+// Adds the tables of one semiring, with values of the given size. The rows
+// of lazy tables are allocated as they are written, so that they are only
+// bounded by the full tables. Mapped tables are counted on disk.
+void add_tables(Footprint &fp, const char *name, unsigned w, unsigned value_size)
+{
+	RowAllocation allocation = table_allocation();
+	unsigned long long pointers = 3 * set_indices(N, w) * sizeof(void*);
+	unsigned long long values = 3 * SetArray::estimate(N, w) * value_size;
+	
+	fp.add("row pointers", pointers);
+	if (opt_load_tables != NULL || allocation == ALLOCATE_MAPPED) {
+		fp.disk += values;
+	} else {
+		fp.add(name, values, allocation == ALLOCATE_LAZY);
+	}
+	
+	// the states of the parallel solver
+	if (!opt_bottom_up && opt_threads > 1 && opt_load_tables == NULL) {
+		fp.add("row pointers", pointers);
+		fp.add("solver states", 3 * SetArray::estimate(N, w), true);
+	}
+}
+
+// computes the footprint of an action (and its arguments) for maximum width w
+Footprint footprint(const char **action, unsigned w)
+{
+	const char *name = *action != NULL ? *action : "max";
+	bool count = !strcmp(name, "count");
+	bool max = !strcmp(name, "max") || !strcmp(name, "kbest");
+	bool sum = !strcmp(name, "sample") || !strcmp(name, "edges");
+	bool both = !strcmp(name, "serve") || !strcmp(name, "update");
+	
+	// update can keep the tables of one semiring only
+	if (!strcmp(name, "update") && action[1] != NULL && action[2] != NULL) {
+		max = !strcmp(action[2], "max");
+		sum = !strcmp(action[2], "sum");
+		both = false;
+	}
+	unsigned real_size = opt_single_precision && !(max && opt_branch_and_bound) ? sizeof(float) : sizeof(double);
+	
+	Footprint fp;
+	fp.add("local scores", set_indices(N, M) * sizeof(double));
+	
+	if (count) add_tables(fp, "count tables", w, sizeof(count_t));
+	if (max || both) add_tables(fp, "max tables", w, real_size);
+	
+	// serve frees the max tables before it allocates the sum tables
+	if (sum || (both && !strcmp(name, "update"))) add_tables(fp, "sum tables", w, real_size);
+	
+	if (!strcmp(name, "max") && opt_load_tables == NULL) {
+		unsigned long long pointers = 3 * set_indices(N, w) * sizeof(void*);
+		unsigned long long entries = 3 * SetArray::estimate(N, w);
+		if (opt_argmax) {
+			fp.add("row pointers", pointers);
+			if (table_allocation() == ALLOCATE_MAPPED) fp.disk += entries * sizeof(Set);
+			else fp.add("argmax tables", entries * sizeof(Set), table_allocation() == ALLOCATE_LAZY);
+		}
+		if (opt_branch_and_bound) {
+			fp.add("row pointers", pointers);
+			fp.add("branch and bound states", entries, true);
+		}
+	}
+	
+	// the outside tables of the edge marginals, always in double precision,
+	// and the expected numbers of nodes by clique
+	if (!strcmp(name, "edges") || !strcmp(name, "serve")) {
+		RowAllocation allocation = table_allocation();
+		unsigned long long values = 3 * SetArray::estimate(N, w) * sizeof(double);
+		fp.add("row pointers", 3 * set_indices(N, w) * sizeof(void*));
+		if (allocation == ALLOCATE_MAPPED) fp.disk += values;
+		else fp.add("outside tables", values, allocation == ALLOCATE_LAZY);
+		fp.add("node marginals", set_indices(N, w) * sizeof(double));
+	}
+	
+	if (opt_subset_convolution && opt_procs == 1 && (count || sum || both)) {
+		fp.add("subset convolution", convolution_bytes(w, count));
+	}
+	
+	// Each sample uses at most 3N caches (a SampleCache each), whose buffers
+	// hold at most twice the number of sets drawn from them plus one, and
+	// allocates at most one row of a table for each.
+	if (!strcmp(name, "sample") && !opt_naive_sampling) {
+		unsigned long long samples = action[1] != NULL ? strtoull(action[1], NULL, 10) : 1;
+		unsigned long long caches = samples * 3 * N;
+		unsigned long long entries = 3 * SetArray::estimate(N, w);
+		// the smaller of caches << N and the entries, without shifting out bits
+		unsigned long long rows = N < 64 && caches <= entries >> N ? caches << N : entries;
+		fp.add("row pointers", 3 * set_indices(N, w) * sizeof(void*));
+		fp.add("sample cache rows", rows * sizeof(void*), true);
+		fp.add("sample caches", caches * (sizeof(Set*) + 2 * sizeof(unsigned) + 3 * sizeof(Set)), true);
+	}
+	
+	return fp;
+}
+
+
+// returns the space available in a directory for scratch files, 0 if the
+// directory is in memory (tmpfs) or cannot be used
+unsigned long long scratch_space(const char *directory)
+{
+	struct statfs fs;
+	struct statvfs vfs;
+	if (statfs(directory, &fs) != 0 || fs.f_type == TMPFS_MAGIC) return 0;
+	if (statvfs(directory, &vfs) != 0) return 0;
+	return (unsigned long long)vfs.f_bavail * vfs.f_frsize;
+}
+
+// Plans the memory of an action within opt_memory_limit before anything is
+// allocated. If the footprint with the given options exceeds the limit, the
+// tables are stored in single precision where possible, or else mapped to
+// scratch files in the given scratch directory ($TMPDIR or /var/tmp by
+// default) if it has room for them and is not in memory. If neither fits,
+// reports the largest maximum width that would and returns 1.
+int plan_memory(const char **action)
+{
+	unsigned long long limit = opt_memory_limit;
+	
+	Footprint fp = footprint(action, W);
+	if (opt_verbose) {
+		printf("Memory plan (limit %.2f M):\n", limit / 1024.0 / 1024.0);
+		fp.print();
+	}
+	if (fp.memory <= limit) return 0;
+	
+	const char *name = *action != NULL ? *action : "max";
+	bool real = strcmp(name, "count") && !(!strcmp(name, "max") && opt_branch_and_bound);
+	
+	if (real && !opt_single_precision && opt_load_tables == NULL) {
+		opt_single_precision = 1;
+		fp = footprint(action, W);
+		if (fp.memory <= limit) {
+			vbprintf("Storing the tables in single precision (-f) to fit:\n");
+			if (opt_verbose) fp.print();
+			return 0;
+		}
+		opt_single_precision = 0;
+	}
+	
+	if (opt_scratch_directory == NULL && opt_load_tables == NULL) {
+		const char *directory = getenv("TMPDIR") != NULL ? getenv("TMPDIR") : "/var/tmp";
+		opt_scratch_directory = directory;
+		fp = footprint(action, W);
+		if (fp.memory <= limit && fp.disk <= scratch_space(directory)) {
+			vbprintf("Mapping the tables to scratch files in %s to fit:\n", directory);
+			if (opt_verbose) fp.print();
+			return 0;
+		}
+		opt_scratch_directory = NULL;
+	}
+	
+	printf("Error: The computation needs %.2f M of memory, more than the limit of %.2f M.\n",
+		footprint(action, W).memory / 1024.0 / 1024.0, limit / 1024.0 / 1024.0);
+	
+	// the largest width that fits with the given options, in single precision if possible
+	if (real && opt_load_tables == NULL) opt_single_precision = 1;
+	unsigned w = W - 1;
+	while (w >= 1 && footprint(action, w).memory > limit) w--;
+	
+	if (w >= 1) {
+		printf("The largest maximum width that fits is %u%s.\n", w, opt_single_precision ? " (with -f)" : "");
+	} else {
+		printf("Not even maximum width 1 fits.\n");
+	}
+	return 1;
+}
+
+// Without a limit, refuses a run before anything is allocated if the
+// structures that are allocated in full already need more memory than the
+// machine has. Tables that are allocated as they are used are left to the
+// allocation itself. Returns 1 if the run is refused.
+int check_memory(const char **action)
+{
+	unsigned long long physical = (unsigned long long)sysconf(_SC_PHYS_PAGES) * sysconf(_SC_PAGE_SIZE);
+	
+	Footprint fp = footprint(action, W);
+	unsigned long long exact = 0;
+	for (unsigned i = 0; i < fp.items.size(); i++) {
+		if (!fp.items[i].bound) exact += fp.items[i].bytes;
+	}
+	if (physical == 0 || exact <= physical) return 0;
+	
+	printf("Error: The computation needs %.2f M of memory, more than the %.2f M of this machine.\n",
+		exact / 1024.0 / 1024.0, physical / 1024.0 / 1024.0);
+	printf("Plan it with --mem-limit, or keep the tables in scratch files with --scratch.\n");
+	return 1;
+}
@@ -19,92 +19,15 @@
 
 #include <ctime>
 
-#include "common.hpp"
+#include "kernel.hpp"
 #include "discretedist.hpp"
 
 
-double compute_sum_f(Set S, Set R);
-double compute_sum_g(Set C, Set U);
-double compute_sum_h(Set C, Set R);
-
-
-double compute_sum_h(Set C, Set R)
-{
-	double cached = h_values->get(C.bits, R.bits);
-	if (cached != -INFTY) return cached;
-	
-	double sum_score = -INFTY;
-	
-	H_ITERATE(it) {
-		Set S = it.set();
-		
-		double score_s = local_score(S);
-		double score_f = compute_sum_f(S, R);
-		double score = score_f - score_s;
-		
-		sum_score = logsum(sum_score, score);
-	}
-	
-	h_values->set(C.bits, R.bits, sum_score);
-	return sum_score;
-}
-
-
-double compute_sum_g(Set C, Set U)
-{
-	double cached = g_values->get(C.bits, U.bits);
-	if (cached != -INFTY) return cached;
-	
-	if (U.is_empty()) {
-		g_values->set(C.bits, U.bits, 0.0);
-		return 0.0;
-	}
-	
-	double sum_score = -INFTY;
-	
-	G_ITERATE(it) {
-		Set R = it.set();
-		
-		double score_h = compute_sum_h(C, R);
-		double score_g = compute_sum_g(C, U ^ R);
-		double score = score_h + score_g;
-		
-		sum_score = logsum(sum_score, score);
-	}
-	
-	g_values->set(C.bits, U.bits, sum_score);
-	return sum_score;
-}
-
-
-double compute_sum_f(Set S, Set R)
-{
-	double cached = f_values->get(S.bits, R.bits);
-	if (cached != -INFTY) return cached;
-	
-	double sum_score = -INFTY;
-	
-	F_ITERATE(it) {
-		Set D = it.set();
-		Set C = S | D;
-		
-		double score_c = local_score(C);
-		double score_g = compute_sum_g(C, R ^ D);
-		double score = score_c + score_g;
-		
-		sum_score = logsum(sum_score, score);
-	}
-	
-	f_values->set(S.bits, R.bits, sum_score);
-	return sum_score;
-}
-
-
-
-TreeNode<Set> *sample_naive();
+template <typename Tables>
+TreeNode<Set> *sample_naive(Tables &t);
 void sampling_adaptive_init();
 void sampling_adaptive_uninit();
-TreeNode<Set> *sample_adaptive();
+TreeNode<Set> *sample_adaptive(SumTables &t);
 
 
 
@@ -116,15 +39,21 @@ struct Sampler
 
 struct NaiveSampler : public Sampler
 {
+	SumTables &tables;
+	
+	NaiveSampler(SumTables &tables) : tables(tables) {}
+	
 	TreeNode<Set> *sample()
 	{
-		return sample_naive();
+		return sample_naive(tables);
 	}
 };
 
 struct AdaptiveSampler : public Sampler
 {
-	AdaptiveSampler()
+	SumTables &tables;
+	
+	AdaptiveSampler(SumTables &tables) : tables(tables)
 	{
 		sampling_adaptive_init();
 	}
@@ -136,7 +65,7 @@ struct AdaptiveSampler : public Sampler
 	
 	TreeNode<Set> *sample()
 	{
-		return sample_adaptive();
+		return sample_adaptive(tables);
 	}
 };
 
@@ -228,11 +157,14 @@ void sampling(const char **argv)
 	
 // 	double t_start = get_time();
 	
-	allocate_tables();
+	allocate_tables(SumSemiring::name());
+	
+	SumTables tables(f_values, g_values, h_values);
 	
-	vbprintf("\nComputing sum tables...\n");
-	double sum_score = compute_sum_f(Set::empty(N), Set::complete(N));
+	vbprintf("\nComputing sum tables (log-sum-exp: %s)...\n", logsumexp_name());
+	double sum_score = compute_tables(tables);
 	vbprintf("Total score: %f\n", sum_score);
+	if (opt_single_precision) vbprintf("Single precision: total score within %g\n", single_precision_error());
 	
 // 	double t_sums = get_time();
 // 	if (opt_output_sample_times) printf("DP time:    %f\n", t_sums - t_start);
@@ -240,9 +172,9 @@ void sampling(const char **argv)
 	Sampler *sampler;
 	
 	if (opt_naive_sampling) {
-		sampler = new NaiveSampler();
+		sampler = new NaiveSampler(tables);
 	} else {
-		sampler = new AdaptiveSampler();
+		sampler = new AdaptiveSampler(tables);
 	}
 	
 	sample(n_samples, sampler);
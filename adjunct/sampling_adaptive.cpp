@@ -17,7 +17,7 @@
  *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
-#include "common.hpp"
+#include "kernel.hpp"
 #include "discretedist.hpp"
 
 
@@ -93,25 +93,23 @@ bool free_sample_cache(DisjointPairArray<SampleCache*> *samples, Set X, Set Y)
 
 
 
-double compute_sum_f(Set S, Set R);
-double compute_sum_g(Set C, Set U);
-double compute_sum_h(Set C, Set R);
+typedef Recurrence<SumSemiring> Sum;
 
 
-void rebuild_cache_h(Set C, Set R, SampleCache *cache)
+// With the tables in single precision (-f), each total is recomputed from the
+// terms, so that the probabilities of the terms sum to one.
+void rebuild_cache_h(SumTables &t, Set C, Set R, SampleCache *cache)
 {
-	double total = compute_sum_h(C, R);
+	double total = opt_single_precision ? Sum::h(t, C, R) : t.h(C, R);
 	double sum_score = -INFTY;
 	
 	std::vector<double> probs;
 	std::vector<Set> sets;
 	
-	H_ITERATE(it) {
+	for (h_iterator it(C); it.has_next(); ++it) {
 		Set S = it.set();
 		
-		double score_s = local_score(S);
-		double score_f = compute_sum_f(S, R);
-		double score = score_f - score_s;
+		double score = Sum::h_term(t, S, R);
 		
 		sum_score = logsum(sum_score, score - total);
 		
@@ -122,20 +120,18 @@ void rebuild_cache_h(Set C, Set R, SampleCache *cache)
 	cache->build(probs, sets);
 }
 
-void rebuild_cache_g(Set C, Set U, SampleCache *cache)
+void rebuild_cache_g(SumTables &t, Set C, Set U, SampleCache *cache)
 {
-	double total = compute_sum_g(C, U);
+	double total = opt_single_precision ? Sum::g(t, C, U) : t.g(C, U);
 	double sum_score = -INFTY;
 	
 	std::vector<double> probs;
 	std::vector<Set> sets;
 	
-	G_ITERATE(it) {
+	for (g_iterator it(U); it.has_next(); ++it) {
 		Set R = it.set();
 		
-		double score_h = compute_sum_h(C, R);
-		double score_g = compute_sum_g(C, U ^ R);
-		double score = score_h + score_g;
+		double score = Sum::g_term(t, C, U, R);
 		
 		sum_score = logsum(sum_score, score - total);
 		
@@ -146,21 +142,18 @@ void rebuild_cache_g(Set C, Set U, SampleCache *cache)
 	cache->build(probs, sets);
 }
 
-void rebuild_cache_f(Set S, Set R, SampleCache *cache)
+void rebuild_cache_f(SumTables &t, Set S, Set R, SampleCache *cache)
 {
-	double total = compute_sum_f(S, R);
+	double total = opt_single_precision ? Sum::f(t, S, R) : t.f(S, R);
 	double sum_score = -INFTY;
 	
 	std::vector<double> probs;
 	std::vector<Set> sets;
 	
-	F_ITERATE(it) {
+	for (f_iterator it(S, R, SumSemiring::fix_first); it.has_next(); ++it) {
 		Set D = it.set();
-		Set C = S | D;
 		
-		double score_c = local_score(C);
-		double score_g = compute_sum_g(C, R ^ D);
-		double score = score_c + score_g;
+		double score = Sum::f_term(t, S, R, D);
 		
 		sum_score = logsum(sum_score, score - total);
 		
@@ -173,49 +166,49 @@ void rebuild_cache_f(Set S, Set R, SampleCache *cache)
 
 
 
-TreeNode<Set> *sample_f_adaptive(Set S, Set R, TreeNode<Set> *node);
-void sample_h_adaptive(Set C, Set R, TreeNode<Set> *node);
-void sample_g_adaptive(Set C, Set U, TreeNode<Set> *node);
+TreeNode<Set> *sample_f_adaptive(SumTables &t, Set S, Set R, TreeNode<Set> *node);
+void sample_h_adaptive(SumTables &t, Set C, Set R, TreeNode<Set> *node);
+void sample_g_adaptive(SumTables &t, Set C, Set U, TreeNode<Set> *node);
 
 
-void sample_h_adaptive(Set C, Set R, TreeNode<Set> *node)
+void sample_h_adaptive(SumTables &t, Set C, Set R, TreeNode<Set> *node)
 {
 	SampleCache *cache = get_sample_cache(h_samples, C, R);
-	if (cache->size == 0) rebuild_cache_h(C, R, cache);
+	if (cache->size == 0) rebuild_cache_h(t, C, R, cache);
 	
 	Set S = cache->consume();
-	sample_f_adaptive(S, R, node);
+	sample_f_adaptive(t, S, R, node);
 }
 
-void sample_g_adaptive(Set C, Set U, TreeNode<Set> *node)
+void sample_g_adaptive(SumTables &t, Set C, Set U, TreeNode<Set> *node)
 {
 	if (U.is_empty()) return;
 	
 	SampleCache *cache = get_sample_cache(g_samples, C, U);
-	if (cache->size == 0) rebuild_cache_g(C, U, cache);
+	if (cache->size == 0) rebuild_cache_g(t, C, U, cache);
 	
 	Set R = cache->consume();
-	sample_h_adaptive(C, R, node);
-	sample_g_adaptive(C, U ^ R, node);
+	sample_h_adaptive(t, C, R, node);
+	sample_g_adaptive(t, C, U ^ R, node);
 }
 
-TreeNode<Set> *sample_f_adaptive(Set S, Set R, TreeNode<Set> *node)
+TreeNode<Set> *sample_f_adaptive(SumTables &t, Set S, Set R, TreeNode<Set> *node)
 {
 	SampleCache *cache = get_sample_cache(f_samples, S, R);
-	if (cache->size == 0) rebuild_cache_f(S, R, cache);
+	if (cache->size == 0) rebuild_cache_f(t, S, R, cache);
 	
 	Set D = cache->consume();
 	Set C = S | D;
 	
 	TreeNode<Set> *child = new TreeNode<Set>(C, S);
 	if (node != NULL) node->add(child);
-	sample_g_adaptive(C, R ^ D, child);
+	sample_g_adaptive(t, C, R ^ D, child);
 	return child;
 }
 
-TreeNode<Set> *sample_adaptive()
+TreeNode<Set> *sample_adaptive(SumTables &t)
 {
-	return sample_f_adaptive(Set::empty(N), Set::complete(N), (TreeNode<Set>*)NULL);
+	return sample_f_adaptive(t, Set::empty(N), Set::complete(N), (TreeNode<Set>*)NULL);
 }
 
 
@@ -230,7 +223,7 @@ void free_cache_h(Set C, Set R)
 {
 	if (!free_sample_cache(h_samples, C, R)) return;
 	
-	H_ITERATE(it) {
+	for (h_iterator it(C); it.has_next(); ++it) {
 		Set S = it.set();
 		free_cache_f(S, R);
 	}
@@ -242,7 +235,7 @@ void free_cache_g(Set C, Set U)
 	
 	if (!free_sample_cache(g_samples, C, U)) return;
 	
-	G_ITERATE(it) {
+	for (g_iterator it(U); it.has_next(); ++it) {
 		Set R = it.set();
 		free_cache_h(C, R);
 		free_cache_g(C, U ^ R);
@@ -253,7 +246,7 @@ void free_cache_f(Set S, Set R)
 {
 	if (!free_sample_cache(f_samples, S, R)) return;
 	
-	F_ITERATE(it) {
+	for (f_iterator it(S, R, SumSemiring::fix_first); it.has_next(); ++it) {
 		Set D = it.set();
 		Set C = S | D;
 		free_cache_g(C, R ^ D);
@@ -266,9 +259,10 @@ void free_cache_f(Set S, Set R)
 
 void sampling_adaptive_init()
 {
-	f_samples = new DisjointPairArray<SampleCache*>(N, N, NULL);
-	g_samples = new DisjointPairArray<SampleCache*>(N, N, NULL);
-	h_samples = new DisjointPairArray<SampleCache*>(N, N, NULL);
+	// only the rows of the entries that are sampled are allocated
+	f_samples = new DisjointPairArray<SampleCache*>(N, W, NULL, ALLOCATE_LAZY);
+	g_samples = new DisjointPairArray<SampleCache*>(N, W, NULL, ALLOCATE_LAZY);
+	h_samples = new DisjointPairArray<SampleCache*>(N, W, NULL, ALLOCATE_LAZY);
 }
 
 void sampling_adaptive_uninit()
@@ -17,107 +17,116 @@
  *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
-#include "common.hpp"
+#include "kernel.hpp"
 
-double compute_sum_f(Set S, Set R);
-double compute_sum_g(Set C, Set U);
-double compute_sum_h(Set C, Set R);
+typedef Recurrence<SumSemiring> Sum;
 
-TreeNode<Set> *sample_f_naive(Set S, Set R, TreeNode<Set> *node);
-void sample_h_naive(Set C, Set R, TreeNode<Set> *node);
-void sample_g_naive(Set C, Set U, TreeNode<Set> *node);
+template <typename Tables>
+TreeNode<Set> *sample_f_naive(Tables &t, Set S, Set R, TreeNode<Set> *node);
+template <typename Tables>
+void sample_h_naive(Tables &t, Set C, Set R, TreeNode<Set> *node);
+template <typename Tables>
+void sample_g_naive(Tables &t, Set C, Set U, TreeNode<Set> *node);
 
 
 
 
-void sample_h_naive(Set C, Set R, TreeNode<Set> *node)
+// With the tables in single precision (-f), each total is recomputed from the
+// terms, so that the probabilities of the terms sum to one. Otherwise the
+// total was summed by LogSumExp in another order than the running sum here,
+// and with --logsum=fast the terms may add up to slightly less than it, so if
+// the running sum never reaches P, the last term of nonzero weight is taken.
+template <typename Tables>
+void sample_h_naive(Tables &t, Set C, Set R, TreeNode<Set> *node)
 {
-	double total = compute_sum_h(C, R);
+	double total = opt_single_precision ? Sum::h(t, C, R) : t.h(C, R);
 	double P = log(rnd()) + total;
 	
 	double sum_score = -INFTY;
+	Set last = Set::empty(N);
 	
-	H_ITERATE(it) {
+	for (h_iterator it(C); it.has_next(); ++it) {
 		Set S = it.set();
 		
-		double score_s = local_score(S);
-		double score_f = compute_sum_f(S, R);
-		double score = score_f - score_s;
+		double score = Sum::h_term(t, S, R);
+		if (score == -INFTY) continue;
 		
 		sum_score = logsum(sum_score, score);
+		last = S;
 		
-		if (sum_score >= P) {
-			sample_f_naive(S, R, node);
-			return;
-		}
+		if (sum_score >= P) break;
 	}
 	
-	assert(0);
+	assert(sum_score != -INFTY);
+	sample_f_naive(t, last, R, node);
 }
 
 
-void sample_g_naive(Set C, Set U, TreeNode<Set> *node)
+template <typename Tables>
+void sample_g_naive(Tables &t, Set C, Set U, TreeNode<Set> *node)
 {
 	if (U.is_empty()) return;
 	
-	double total = compute_sum_g(C, U);
+	double total = opt_single_precision ? Sum::g(t, C, U) : t.g(C, U);
 	double P = log(rnd()) + total;
 	
 	double sum_score = -INFTY;
+	Set last = Set::empty(N);
 	
-	G_ITERATE(it) {
+	for (g_iterator it(U); it.has_next(); ++it) {
 		Set R = it.set();
 		
-		double score_h = compute_sum_h(C, R);
-		double score_g = compute_sum_g(C, U ^ R);
-		double score = score_h + score_g;
+		double score = Sum::g_term(t, C, U, R);
+		if (score == -INFTY) continue;
 		
 		sum_score = logsum(sum_score, score);
+		last = R;
 		
-		if (sum_score >= P) {
-			sample_h_naive(C, R, node);
-			sample_g_naive(C, U ^ R, node);
-			return;
-		}
+		if (sum_score >= P) break;
 	}
 	
-	assert(0);
+	assert(sum_score != -INFTY);
+	sample_h_naive(t, C, last, node);
+	sample_g_naive(t, C, U ^ last, node);
 }
 
 
-TreeNode<Set> *sample_f_naive(Set S, Set R, TreeNode<Set> *node)
+template <typename Tables>
+TreeNode<Set> *sample_f_naive(Tables &t, Set S, Set R, TreeNode<Set> *node)
 {
-	double total = compute_sum_f(S, R);
+	double total = opt_single_precision ? Sum::f(t, S, R) : t.f(S, R);
 	double P = log(rnd()) + total;
 	
 	double sum_score = -INFTY;
+	Set last = Set::empty(N);
 	
-	F_ITERATE(it) {
+	for (f_iterator it(S, R, SumSemiring::fix_first); it.has_next(); ++it) {
 		Set D = it.set();
-		Set C = S | D;
 		
-		double score_c = local_score(C);
-		double score_g = compute_sum_g(C, R ^ D);
-		double score = score_c + score_g;
+		double score = Sum::f_term(t, S, R, D);
+		if (score == -INFTY) continue;
 		
 		sum_score = logsum(sum_score, score);
+		last = D;
 		
-		if (sum_score >= P) {
-			TreeNode<Set> *child = new TreeNode<Set>(C, S);
-			if (node != NULL) node->add(child);
-			sample_g_naive(C, R ^ D, child);
-			return child;
-		}
+		if (sum_score >= P) break;
 	}
 	
-	assert(0);
+	assert(sum_score != -INFTY);
+	Set C = S | last;
+	TreeNode<Set> *child = new TreeNode<Set>(C, S);
+	if (node != NULL) node->add(child);
+	sample_g_naive(t, C, R ^ last, child);
+	return child;
 }
 
 
-TreeNode<Set> *sample_naive()
+template <typename Tables>
+TreeNode<Set> *sample_naive(Tables &t)
 {
-	return sample_f_naive(Set::empty(N), Set::complete(N), (TreeNode<Set>*)NULL);
+	return sample_f_naive(t, Set::empty(N), Set::complete(N), (TreeNode<Set>*)NULL);
 }
 
-
-
+// the resident tables of serve are read as filled, without computing entries
+template TreeNode<Set> *sample_naive(SumTables &t);
+template TreeNode<Set> *sample_naive(FilledSumTables &t);
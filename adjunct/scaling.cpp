@@ -0,0 +1,292 @@
+/*
+ *  Adjunct
+ *  
+ *  Copyright 2015 Kustaa Kangas <jwkangas(at)cs.helsinki.fi>
+ *  
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *  
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *  
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+
+// Runs max and sample over a grid of numbers of variables N and maximum widths
+// W on synthetic score files, and records the wall time, the peak resident
+// memory and the size of the DP tables of each run, as tab-separated lines
+//
+//   n  m  w  action  status  seconds  peak_rss_mb  values_allocated  values_total
+//
+// The score files are written by dmscore -s, which computes BDeu scores for
+// data simulated from a random Bayesian network, with scores up to the largest
+// width m of the grid. They are kept and reused by later runs. The status is
+// ok, timeout if the run was stopped, or failed (e.g. N beyond the limit of
+// the build, see make wide). The values allocated are those reported by
+// adjunct -v, and the total is that of the complete tables, also for the runs
+// that did not finish.
+
+std::vector<unsigned> opt_ns = { 8, 10, 12, 14, 16 };
+std::vector<unsigned> opt_ws = { 2, 3, 4 };
+std::vector<std::string> opt_actions = { "max", "sample" };
+unsigned opt_records = 500;
+unsigned opt_samples = 100;
+unsigned opt_timeout = 600;
+std::string opt_flags = "";
+std::string opt_threads = "";
+std::string opt_dmscore = "../dmscore/dmscore";
+std::string opt_adjunct = "./adjunct";
+std::string opt_dir = ".";
+
+
+// result of running a program
+struct Run
+{
+	int status;		// as returned by wait4
+	double seconds;
+	long peak_rss;	// in kilobytes
+	std::string output;
+};
+
+// runs a program with its standard output sent to output_file, or collected in
+// the output of the result if output_file is NULL, stopping it after the timeout
+Run run(std::vector<std::string> args, const char *output_file, unsigned timeout)
+{
+	typedef std::chrono::steady_clock Clock;
+	Run r;
+	r.peak_rss = 0;
+	
+	int fds[2];
+	if (output_file == NULL && pipe(fds) != 0) {
+		perror("pipe");
+		exit(1);
+	}
+	
+	Clock::time_point start = Clock::now();
+	pid_t pid = fork();
+	if (pid == 0) {
+		int fd = output_file != NULL ? open(output_file, O_WRONLY | O_CREAT | O_TRUNC, 0644) : fds[1];
+		if (fd < 0) _exit(127);
+		dup2(fd, STDOUT_FILENO);
+		if (output_file == NULL) close(fds[0]);
+		
+		std::vector<char*> argv;
+		for (unsigned i = 0; i < args.size(); i++) argv.push_back((char*)args[i].c_str());
+		argv.push_back(NULL);
+		
+		// the alarm survives exec and stops the program
+		if (timeout > 0) alarm(timeout);
+		execv(argv[0], argv.data());
+		_exit(127);
+	}
+	
+	if (output_file == NULL) {
+		close(fds[1]);
+		char buffer[4096];
+		ssize_t n;
+		while ((n = read(fds[0], buffer, sizeof(buffer))) > 0) r.output.append(buffer, n);
+		close(fds[0]);
+	}
+	
+	struct rusage usage;
+	wait4(pid, &r.status, 0, &usage);
+	r.seconds = std::chrono::duration<double>(Clock::now() - start).count();
+	r.peak_rss = usage.ru_maxrss;
+	return r;
+}
+
+// returns the synthetic score file of n variables with scores up to size m,
+// writing it first if it does not exist
+std::string score_file(unsigned n, unsigned m)
+{
+	char name[256];
+	snprintf(name, sizeof(name), "%s/synthetic-%u-%u.score", opt_dir.c_str(), n, m);
+	if (access(name, R_OK) == 0) return name;
+	
+	printf("Writing %s...\n", name);
+	fflush(stdout);
+	char simulation[64];
+	snprintf(simulation, sizeof(simulation), "%u,%u,%u", n, opt_records, n);
+	Run r = run({ opt_dmscore, "-s", simulation, "1", std::to_string(m) }, name, 0);
+	if (!WIFEXITED(r.status) || WEXITSTATUS(r.status) != 0) {
+		printf("Error: Could not write the scores by %s.\n", opt_dmscore.c_str());
+		unlink(name);
+		exit(1);
+	}
+	return name;
+}
+
+// the number of values in the tables f, g and h of width w, as in
+// DisjointPairArray::estimate, in floating point since it may not fit 64 bits
+double table_values(unsigned n, unsigned w)
+{
+	double values = 0, binom = 1;
+	for (unsigned k = 0; k <= w && k <= n; k++) {
+		values += binom * ldexp(1, n - k);
+		binom = binom * (n - k) / (k + 1);
+	}
+	return 3 * values;
+}
+
+void measure(FILE *out, unsigned n, unsigned m, unsigned w, const std::string &action)
+{
+	std::vector<std::string> args = { opt_adjunct };
+	if (!opt_threads.empty()) args.push_back("--threads=" + opt_threads);
+	args.push_back("-v" + opt_flags);
+	args.push_back(score_file(n, m));
+	args.push_back(std::to_string(w));
+	args.push_back(action);
+	if (action == "sample") {
+		args.push_back(std::to_string(opt_samples));
+		args.push_back("1");
+	}
+	
+	Run r = run(args, NULL, opt_timeout);
+	
+	long long unsigned allocated = 0, total;
+	const char *line = strstr(r.output.c_str(), "Table values allocated: ");
+	bool sized = line != NULL && sscanf(line, "Table values allocated: %llu of %llu", &allocated, &total) == 2;
+	
+	const char *status = "failed";
+	if (WIFSIGNALED(r.status) && WTERMSIG(r.status) == SIGALRM) status = "timeout";
+	else if (WIFEXITED(r.status) && WEXITSTATUS(r.status) == 0 && sized) status = "ok";
+	
+	fprintf(out, "%u\t%u\t%u\t%s\t%s\t%.3f\t%.1f\t%llu\t%.0f\n", n, m, w, action.c_str(), status,
+		r.seconds, r.peak_rss / 1024.0, allocated, table_values(n, w));
+	fflush(out);
+	printf("N=%-3u W=%-2u %-7s %-8s %10.3f s %10.1f MB\n", n, w, action.c_str(), status, r.seconds, r.peak_rss / 1024.0);
+	fflush(stdout);
+}
+
+
+// parses a comma-separated list
+std::vector<std::string> split(const char *s)
+{
+	std::vector<std::string> items;
+	std::string item;
+	for (; ; s++) {
+		if (*s == ',' || *s == '\0') {
+			if (!item.empty()) items.push_back(item);
+			item.clear();
+			if (*s == '\0') break;
+		} else {
+			item += *s;
+		}
+	}
+	return items;
+}
+
+std::vector<unsigned> split_numbers(const char *s)
+{
+	std::vector<std::string> items = split(s);
+	std::vector<unsigned> numbers;
+	for (unsigned i = 0; i < items.size(); i++) numbers.push_back(atoi(items[i].c_str()));
+	return numbers;
+}
+
+// reads an option of the form --name=value
+int read_option(const char *option)
+{
+	const char *value = strchr(option, '=');
+	if (value == NULL) {
+		printf("Error: Option without a value: %s\n\n", option);
+		return 0;
+	}
+	value++;
+	
+	if (!strncmp(option, "--ns=", value - option)) opt_ns = split_numbers(value);
+	else if (!strncmp(option, "--ws=", value - option)) opt_ws = split_numbers(value);
+	else if (!strncmp(option, "--actions=", value - option)) opt_actions = split(value);
+	else if (!strncmp(option, "--records=", value - option)) opt_records = atoi(value);
+	else if (!strncmp(option, "--samples=", value - option)) opt_samples = atoi(value);
+	else if (!strncmp(option, "--timeout=", value - option)) opt_timeout = atoi(value);
+	else if (!strncmp(option, "--flags=", value - option)) opt_flags = value;
+	else if (!strncmp(option, "--threads=", value - option)) opt_threads = value;
+	else if (!strncmp(option, "--dmscore=", value - option)) opt_dmscore = value;
+	else if (!strncmp(option, "--adjunct=", value - option)) opt_adjunct = value;
+	else if (!strncmp(option, "--dir=", value - option)) opt_dir = value;
+	else {
+		printf("Error: Unknown option: %s\n\n", option);
+		return 0;
+	}
+	
+	return 1;
+}
+
+void print_usage(const char *cmd)
+{
+	printf("Usage: %s [--options] <output file>\n", cmd);
+	printf("\nOptions:\n");
+	printf(" --ns=<list>            numbers of variables (default 8,10,12,14,16)\n");
+	printf(" --ws=<list>            maximum widths (default 2,3,4)\n");
+	printf(" --actions=<list>       actions of adjunct to run (default max,sample)\n");
+	printf(" --records=<r>          records simulated for each score file (default 500)\n");
+	printf(" --samples=<s>          trees drawn by sample (default 100)\n");
+	printf(" --timeout=<s>          seconds before a run is stopped (default 600)\n");
+	printf(" --flags=<letters>      more flags for adjunct, e.g. b or bs\n");
+	printf(" --threads=<n>          threads for adjunct\n");
+	printf(" --dmscore=<path>       the score program (default ../dmscore/dmscore)\n");
+	printf(" --adjunct=<path>       the program measured (default ./adjunct)\n");
+	printf(" --dir=<dir>            where the score files are kept (default .)\n");
+	printf("\nExample:\n");
+	printf("\n%s --ns=16,20,24 --ws=3 --flags=b scaling.tsv\n", cmd);
+	printf("Measure max and sample of width 3 with the tables filled bottom-up.\n");
+}
+
+int main(int argc, const char **argv)
+{
+	const char *cmd = argv[0];
+	int i = 1;
+	for (; i < argc && !strncmp(argv[i], "--", 2); i++) {
+		if (!read_option(argv[i])) {
+			print_usage(cmd);
+			return 1;
+		}
+	}
+	if (i != argc - 1 || opt_ns.empty() || opt_ws.empty()) {
+		print_usage(cmd);
+		return 1;
+	}
+	
+	FILE *out = fopen(argv[i], "w");
+	if (out == NULL) {
+		printf("Error: Could not write: %s\n", argv[i]);
+		return 1;
+	}
+	fprintf(out, "n\tm\tw\taction\tstatus\tseconds\tpeak_rss_mb\tvalues_allocated\tvalues_total\n");
+	
+	unsigned max_w = 0;
+	for (unsigned j = 0; j < opt_ws.size(); j++) if (opt_ws[j] > max_w) max_w = opt_ws[j];
+	
+	for (unsigned a = 0; a < opt_ns.size(); a++) {
+		unsigned n = opt_ns[a];
+		unsigned m = max_w < n ? max_w : n;
+		for (unsigned b = 0; b < opt_ws.size(); b++) {
+			if (opt_ws[b] < 1 || opt_ws[b] > m) continue;
+			for (unsigned c = 0; c < opt_actions.size(); c++) measure(out, n, m, opt_ws[b], opt_actions[c]);
+		}
+	}
+	
+	fclose(out);
+	printf("Results written to %s\n", argv[i]);
+	return 0;
+}
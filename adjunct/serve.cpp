@@ -0,0 +1,265 @@
+/*
+ *  Adjunct
+ *  
+ *  Copyright 2015 Kustaa Kangas <jwkangas(at)cs.helsinki.fi>
+ *  
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *  
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *  
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <ctime>
+#include <cctype>
+#include <cerrno>
+#include <csignal>
+#include <atomic>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "kernel.hpp"
+
+
+TreeNode<Set> *find_optimum();
+template <typename Tables>
+TreeNode<Set> *sample_naive(Tables &t);
+
+
+// The server keeps an optimal tree and the sum tables, which are only read
+// once they have been computed: the sampler reads the entries that the
+// evaluation of f(Ø,V) has stored. They are read as filled tables, since
+// MemoTables would compute again, and write, the entries of value -INFTY
+// (the same as not computed) from concurrent connections. The samples are
+// drawn naively, since the adaptive sampler changes its tables as it samples.
+// Each connection is served by a thread of its own, drawing from its own
+// random number generator.
+TreeNode<Set> *optimal_tree = NULL;
+FilledSumTables *sum_tables = NULL;
+
+// the listening socket, the number of connections being served and the
+// number of requests for seeds
+int server_socket = -1;
+std::atomic<int> connections(0);
+std::atomic<unsigned> seeds(0);
+
+// the edge probabilities over RPTs, computed by the first request for them
+std::once_flag edges_computed;
+double edge_probs[MAX_SET_SIZE * MAX_SET_SIZE];
+
+
+// writes a tree as its score and compact form
+void write_tree(FILE *out, TreeNode<Set> *root)
+{
+	char s[2048];
+	root->serialize(s);
+	fprintf(out, "%f %s\n", root->score(), s);
+}
+
+template <typename Tables>
+void edge_probabilities(Tables &t, double *probs);
+
+// Writes estimates of the edge probabilities from n samples, weighting each
+// sampled tree by one over its number of RPTs as in sample().
+void write_edge_estimates(FILE *out, int n)
+{
+	double weight_total = 0;
+	double edge_weights[MAX_SET_SIZE][MAX_SET_SIZE] = {};
+	
+	for (int k = 0; k < n; k++) {
+		TreeNode<Set> *root = sample_naive(*sum_tables);
+		double weight = 1.0 / (root->count_junction_trees() * root->nodes());
+		weight_total += weight;
+		
+		Graph *G = root->graph();
+		for (unsigned i = 0; i < N-1; i++) {
+			for (unsigned j = i+1; j < N; j++) {
+				if (G->has(i, j)) edge_weights[i][j] += weight;
+			}
+		}
+		delete G;
+		delete root;
+	}
+	
+	fprintf(out, "ok %u\n", N * (N-1) / 2);
+	for (unsigned i = 0; i < N-1; i++) {
+		for (unsigned j = i+1; j < N; j++) {
+			fprintf(out, "%u %u %f\n", i, j, edge_weights[i][j] / weight_total);
+		}
+	}
+}
+
+
+// Answers a request line. Each answer is "ok <k>" followed by k lines, or a
+// single line "error <reason>". Returns 0 if the connection should be closed.
+int serve_request(char *line, FILE *out)
+{
+	char *save;
+	const char *argv[4] = { NULL, NULL, NULL, NULL };
+	int argc = 0;
+	for (char *p = strtok_r(line, " \t\r\n", &save); p != NULL && argc < 4; p = strtok_r(NULL, " \t\r\n", &save)) {
+		argv[argc++] = p;
+	}
+	if (argc == 0) return 1;
+	
+	const char *request = argv[0];
+	
+	if (!strcmp(request, "edges") && argc == 1) {
+		std::call_once(edges_computed, edge_probabilities<FilledSumTables>, std::ref(*sum_tables), edge_probs);
+		fprintf(out, "ok %u\n", N * (N-1) / 2);
+		for (unsigned i = 0; i < N-1; i++) {
+			for (unsigned j = i+1; j < N; j++) fprintf(out, "%u %u %f\n", i, j, edge_probs[i*N+j]);
+		}
+	} else if (!strcmp(request, "sample") || !strcmp(request, "edges")) {
+		// the seed is the same as with the sample action, by default one of its own
+		int n = argc > 1 ? atoi(argv[1]) : 1;
+		unsigned seed = argc > 2 ? strtoul(argv[2], NULL, 10) : time(NULL) + seeds++;
+		if (n < 1) {
+			fprintf(out, "error the number of samples must be at least 1\n");
+		} else {
+			seed_thread_rnd(seed);
+			if (request[0] == 'e') {
+				write_edge_estimates(out, n);
+			} else {
+				fprintf(out, "ok %i\n", n);
+				for (int k = 0; k < n; k++) {
+					TreeNode<Set> *root = sample_naive(*sum_tables);
+					write_tree(out, root);
+					delete root;
+				}
+			}
+		}
+	} else if (!strcmp(request, "max")) {
+		fprintf(out, "ok 1\n");
+		write_tree(out, optimal_tree);
+	} else if (!strcmp(request, "score")) {
+		TreeNode<Set> *root = argc > 1 && isdigit(argv[1][0]) ? parse_tree(argv[1]) : NULL;
+		if (root == NULL) {
+			fprintf(out, "error the tree string is malformed\n");
+		} else {
+			fprintf(out, "ok 1\n%f\n", root->score());
+			delete root;
+		}
+	} else if (!strcmp(request, "quit")) {
+		return 0;
+	} else if (!strcmp(request, "stop")) {
+		// stops accepting connections, the others are served to the end
+		if (server_socket >= 0) shutdown(server_socket, SHUT_RDWR);
+		return 0;
+	} else {
+		fprintf(out, "error unknown request: %s\n", request);
+	}
+	
+	fflush(out);
+	return 1;
+}
+
+void serve_stream(FILE *in, FILE *out)
+{
+	char line[4096];
+	while (fgets(line, sizeof(line), in)) {
+		if (!serve_request(line, out)) break;
+	}
+}
+
+void serve_connection(int fd)
+{
+	FILE *in = fdopen(fd, "r");
+	FILE *out = fdopen(dup(fd), "w");
+	serve_stream(in, out);
+	fclose(in);
+	fclose(out);
+	connections--;
+}
+
+// accepts connections on a Unix domain socket until a stop request
+void serve_socket(const char *path)
+{
+	struct sockaddr_un address;
+	memset(&address, 0, sizeof(address));
+	address.sun_family = AF_UNIX;
+	if (strlen(path) >= sizeof(address.sun_path)) {
+		printf("Error: The socket path is too long: %s\n", path);
+		return;
+	}
+	strcpy(address.sun_path, path);
+	
+	server_socket = socket(AF_UNIX, SOCK_STREAM, 0);
+	unlink(path);
+	if (server_socket < 0 || bind(server_socket, (struct sockaddr*)&address, sizeof(address)) != 0 ||
+		listen(server_socket, 64) != 0) {
+		printf("Error: Could not listen on %s\n", path);
+		return;
+	}
+	
+	// a client closing its connection early must not end the server
+	signal(SIGPIPE, SIG_IGN);
+	
+	printf("ready %s\n", path);
+	fflush(stdout);
+	
+	while (1) {
+		int fd = accept(server_socket, NULL, NULL);
+		if (fd < 0) {
+			if (errno == EINTR || errno == ECONNABORTED) continue;
+			break;
+		}
+		connections++;
+		std::thread(serve_connection, fd).detach();
+	}
+	
+	close(server_socket);
+	unlink(path);
+	
+	while (connections > 0) usleep(10000);
+}
+
+
+// args are [<socket path>], without which requests are read from stdin
+void serve(const char **argv)
+{
+	const char *path = *argv;
+	
+	// the table options apply to the sum tables
+	const char *save_tables = opt_save_tables;
+	const char *load_tables = opt_load_tables;
+	opt_save_tables = opt_load_tables = NULL;
+	
+	vbprintf("\nComputing max tables...\n");
+	optimal_tree = find_optimum();
+	
+	opt_save_tables = save_tables;
+	opt_load_tables = load_tables;
+	
+	allocate_tables(SumSemiring::name());
+	SumTables tables(f_values, g_values, h_values);
+	
+	vbprintf("\nComputing sum tables...\n");
+	double sum_score = compute_tables(tables);
+	vbprintf("Total score: %f\n", sum_score);
+	sum_tables = new FilledSumTables(tables);
+	
+	if (path != NULL) {
+		serve_socket(path);
+	} else {
+		printf("ready\n");
+		fflush(stdout);
+		serve_stream(stdin, stdout);
+	}
+	
+	delete sum_tables;
+	deallocate_tables();
+	delete optimal_tree;
+}
@@ -26,6 +26,10 @@
 #include <cstdlib>
 #include <cstring>
 #include <cstdint>
+#include <atomic>
+#include <type_traits>
+
+#include "tools.hpp"
 
 
 
@@ -33,6 +37,8 @@
 template <typename T>
 struct integer_set
 {
+	typedef T word;
+	
 	T bits;
 	
 	integer_set() {}
@@ -139,6 +145,13 @@ struct integer_set
 		return (T)1 << e;
 	}
 	
+	// returns the largest element, the set must not be empty
+	unsigned last() const
+	{
+		return sizeof(T) > sizeof(unsigned) ? 8 * sizeof(long long) - 1 - __builtin_clzll(bits) :
+			8 * sizeof(unsigned) - 1 - __builtin_clz(bits);
+	}
+	
 	static integer_set empty(unsigned)
 	{
 		return integer_set(0);
@@ -257,9 +270,21 @@ struct integer_set
 };
 
 
+// Sets of up to 32 elements by default, or of up to 64 elements with
+// -DWIDE_SETS. The tables and scores are only stored for the sets up to the
+// maximum width, but a row still has a value for every subset of the other
+// elements, so the number of variables is in practice bounded by memory.
+#ifdef WIDE_SETS
+typedef integer_set<uint64_t> uintset;
+
+#define MAX_SET_SIZE 64
+#else
 typedef integer_set<unsigned int> uintset;
 
 #define MAX_SET_SIZE 32
+#endif
+
+typedef uintset::word set_word;
 
 
 
@@ -292,7 +317,7 @@ struct range_iterator
 		assert((A | B) == B);
 		
 		// count the number of sets
-		n_sets = 1 << (B.cardinality(n) - A.cardinality(n));
+		n_sets = 1ull << (B.cardinality(n) - A.cardinality(n));
 		if (!include_B) n_sets--;
 		
 		// initialize
@@ -332,6 +357,13 @@ struct range_iterator
 	{
 		return index < n_sets;
 	}
+	
+	// continues the iteration from the set X that it reached at index i
+	void seek(long long unsigned i, Set X)
+	{
+		index = i;
+		S = X;
+	}
 };
 
 
@@ -341,31 +373,42 @@ struct range_iterator
 template <typename Set>
 struct range_k_iterator
 {
-	// precomputed binomial coefficients
+	// precomputed binomial coefficients, and the numbers of subsets of i
+	// elements of size at most j
 	static long long unsigned binom[MAX_SET_SIZE+1][MAX_SET_SIZE+1];
+	static long long unsigned at_most[MAX_SET_SIZE+1][MAX_SET_SIZE+1];
 	
-	static long double factorial(unsigned n)
-	{
-		long double fac = 1;
-		for (unsigned i = 2; i <= n; i++) fac *= i;
-		return fac;
-	}
-	
+	// by Pascal's rule, which is exact up to 64 elements
 	static void init(unsigned size)
 	{
 		for (unsigned i = 0; i <= size; i++) {
-			for (unsigned j = 0; j <= i; j++) {
-				binom[i][j] = (long long unsigned)(factorial(i) / factorial(j) / factorial(i-j));
-			}
+			binom[i][0] = binom[i][i] = 1;
+			for (unsigned j = 1; j < i; j++) binom[i][j] = binom[i-1][j-1] + binom[i-1][j];
+			
+			at_most[i][0] = 1;
+			for (unsigned j = 1; j <= size; j++) at_most[i][j] = at_most[i][j-1] + (j <= i ? binom[i][j] : 0);
 		}
 	}
 	
 	// returns the number of subsets of n elements having size at most k
 	static long long unsigned subsets_of_size_at_most(int n, int k)
 	{
-		long long unsigned sets = 0;
-		for (int i = 0; i <= k; i++) sets += binom[n][i];
-		return sets;
+		return k < 0 ? 0 : at_most[n][k];
+	}
+	
+	// Returns the position of X, |X| <= k, among the sets of size at most k in
+	// colex order, i.e., the order in which all such sets are iterated. The
+	// sets before X are those that have, below the first element in which
+	// they differ from X from the top, only the elements that fit in k.
+	static long long unsigned rank(Set X, int k)
+	{
+		long long unsigned r = 0;
+		for (; !X.is_empty(); k--) {
+			unsigned e = X.last();
+			r += at_most[e][k];
+			X.flip(e);
+		}
+		return r;
 	}
 	
 	// total number of sets to iterate over
@@ -380,6 +423,9 @@ struct range_k_iterator
 	// positions of free bits (those that change in iteration)
 	int free_bits[MAX_SET_SIZE];
 	
+	// number of free bits, |B\A|
+	int free_n;
+	
 	// maximum number of free bits that can be 1 at the same time
 	int free_max;
 	
@@ -417,6 +463,7 @@ struct range_k_iterator
 		
 		// get the positions of free bits
 		(B ^ A).get_list(n, free_bits);
+		free_n = card_C;
 		
 		// initially all free bits are 0
 		one_n = 0;
@@ -475,71 +522,344 @@ struct range_k_iterator
 		index++;
 		next();
 	}
+	
+	// continues the iteration from the set X that it reached at index i
+	void seek(long long unsigned i, Set X)
+	{
+		index = i;
+		S = X;
+		
+		// the free 1 bits from the highest down, as next() keeps them
+		one_n = 0;
+		for (int j = free_n - 1; j >= 0; j--) {
+			if (opt_bit(j)) one_bits[one_n++] = j;
+		}
+	}
 };
 
 template <class Set> long long unsigned range_k_iterator<Set>::binom[MAX_SET_SIZE+1][MAX_SET_SIZE+1];
+template <class Set> long long unsigned range_k_iterator<Set>::at_most[MAX_SET_SIZE+1][MAX_SET_SIZE+1];
 
 
+// The position of a set X of size at most k in an array of values for such
+// sets of n elements, and the size of the array. With WIDE_SETS, this is the
+// rank of X, so that the arrays are bounded by k rather than by 2^n, and
+// otherwise the bits of X, which are faster to compute.
+inline long long unsigned set_index(uintset X, unsigned k)
+{
+#ifdef WIDE_SETS
+	return range_k_iterator<uintset>::rank(X, k);
+#else
+	(void)k;
+	return X.bits;
+#endif
+}
 
+inline long long unsigned set_indices(unsigned n, unsigned k)
+{
+#ifdef WIDE_SETS
+	return range_k_iterator<uintset>::subsets_of_size_at_most(n, k);
+#else
+	(void)k;
+	return 1ull << n;
+#endif
+}
 
 
 
 
-// stores a value T for each pair of disjoint subsets of n elements
+// iterates over sets of exactly given size in a given range [A,B] in colexicographic order,
+// uses the binomial coefficients of range_k_iterator, which must be initialized
+template <typename Set>
+struct range_exact_iterator
+{
+	// total number of sets to iterate over
+	long long unsigned n_sets;
+	
+	// index of the current set in iteration
+	long long unsigned index;
+	
+	// current set in iteration
+	Set S;
+	
+	// positions of free bits (those that change in iteration)
+	int free_bits[MAX_SET_SIZE];
+	
+	// number of free bits, |B\A|
+	int free_n;
+	
+	// number of free 1 bits, always k-|A|
+	int one_n;
+	
+	// positions of free 1 bits (relative to free bits) in increasing order
+	int one_bits[MAX_SET_SIZE];
+	
+	// n:     number of elements in the universe
+	// k:     size of sets to iterate over
+	// A, B:  subsets of the universe such that A \subseteq B
+	range_exact_iterator(int n, int k, Set A, Set B)
+	{
+		assert((A | B) == B);
+		
+		// get the positions of free bits
+		free_n = (B ^ A).get_list(n, free_bits);
+		one_n = k - (int)A.cardinality(n);
+		
+		// initialize
+		index = 0;
+		S = A;
+		
+		if (one_n < 0 || one_n > free_n) {
+			n_sets = 0;
+			return;
+		}
+		
+		n_sets = range_k_iterator<Set>::binom[free_n][one_n];
+		
+		// the first set has the lowest free bits set to 1
+		for (int i = 0; i < one_n; i++) {
+			one_bits[i] = i;
+			S.flip(free_bits[i]);
+		}
+	}
+	
+	void next()
+	{
+		if (index == n_sets) return;
+		
+		// find the first free 1 bit that can be moved up by one position
+		int j = 0;
+		while (one_bits[j] + 1 == (j + 1 < one_n ? one_bits[j+1] : free_n)) j++;
+		
+		// move it up
+		S.flip(free_bits[one_bits[j]]);
+		one_bits[j]++;
+		S.flip(free_bits[one_bits[j]]);
+		
+		// and reset the free 1 bits below it to the lowest positions
+		for (int i = 0; i < j; i++) {
+			S.flip(free_bits[one_bits[i]]);
+			one_bits[i] = i;
+			S.flip(free_bits[i]);
+		}
+	}
+	
+	Set& set()
+	{
+		return this->S;
+	}
+	
+	int has_next() const
+	{
+		return index < n_sets;
+	}
+	
+	void operator++ ()
+	{
+		index++;
+		next();
+	}
+};
+
+
+
+
+
+
+
+// how the rows of a DisjointPairArray are allocated
+enum RowAllocation { ALLOCATE_ALL, ALLOCATE_LAZY, ALLOCATE_MAPPED, ALLOCATE_SHARED };
+
+// Stores a value T for each pair of disjoint subsets of n elements, in a row
+// of 2^(n - |x|) values for each x with |x| <= w. The rows are either
+// allocated up front in one array, or lazily, each row when one of its values
+// is first written. Reading a value of a row that has not been allocated gives
+// the initial value. Rows are allocated atomically, so that different threads
+// may write to the same lazy table. Tables that do not fit in memory can be
+// mapped to a scratch file in a directory. Its rows are in the colex order of
+// range_k_iterator, in which the tables are filled bottom-up, so that paging
+// is mostly sequential within each level. The same layout in a shared memory
+// segment lets worker processes fill the tables together. The row pointers
+// are indexed by set_index(x, w).
 template <typename T>
 struct DisjointPairArray
 {
-	unsigned n;
-	T **values;
+	unsigned n, w;
+	bool lazy, value_init;
+	T initial;
+	std::atomic<T*> *values;
 	T *array;
 	
+	// the number of row pointers
+	long long unsigned rows;
+	
+	// the scratch directory (NULL for shared memory) and the size of the mapping, if mapped
+	const char *directory;
+	bool shared;
+	size_t mapped_bytes;
+	
 	static long long unsigned estimate(unsigned n, unsigned w)
 	{
-		long long unsigned x_size = 1 << n;
-		
 		long long unsigned y_size = 0;
-		for (unsigned i = 0; i < x_size; i++) {
-			unsigned k = uintset(i).cardinality(n);
-			if (k > w) continue;
-			y_size += (1 << (n - k));
+		for (unsigned k = 0; k <= w && k <= n; k++) {
+			y_size += range_k_iterator<uintset>::binom[n][k] << (n - k);
 		}
 		
 		return y_size;
 	}
 	
-	DisjointPairArray(unsigned n, unsigned w, T initial) : n(n)
+	DisjointPairArray(unsigned n, unsigned w, T initial, RowAllocation allocation = ALLOCATE_ALL,
+		const char *directory = NULL) : n(n), w(w), lazy(allocation == ALLOCATE_LAZY), value_init(false),
+		initial(initial), rows(set_indices(n, w)),
+		directory(allocation == ALLOCATE_MAPPED ? directory : NULL),
+		shared(allocation == ALLOCATE_SHARED), mapped_bytes(0)
 	{
-		long long unsigned x_size = 1 << n;
-		long long unsigned y_size = estimate(n, w);
+		assert(allocation != ALLOCATE_MAPPED || directory != NULL);
+		allocate();
 		
-		values = new T*[x_size];
+		if (!lazy) fill(array, estimate(n, w), initial, std::true_type());
+	}
+	
+	// uses rows stored elsewhere in the order of range_k_iterator, as if
+	// mapped, without freeing them
+	DisjointPairArray(unsigned n, unsigned w, T initial, T *stored) :
+		n(n), w(w), lazy(false), value_init(false), initial(initial),
+		rows(set_indices(n, w)), directory(NULL), shared(false),
+		mapped_bytes(0)
+	{
+		values = new std::atomic<T*>[rows];
+		array = NULL;
+		place_rows(stored);
+	}
+	
+	// value-initializes all entries, also for types that cannot be copied (e.g. atomics)
+	DisjointPairArray(unsigned n, unsigned w, RowAllocation allocation = ALLOCATE_ALL) :
+		n(n), w(w), lazy(allocation == ALLOCATE_LAZY), value_init(true), initial(),
+		rows(set_indices(n, w)), directory(NULL), shared(false),
+		mapped_bytes(0)
+	{
+		assert(allocation != ALLOCATE_MAPPED && allocation != ALLOCATE_SHARED);
+		allocate();
+	}
+	
+	// sets values to the initial value, unless they were value-initialized
+	// because T cannot be copied
+	static void fill(T *p, long long unsigned size, const T &initial, std::true_type)
+	{
+		for (long long unsigned i = 0; i < size; i++) p[i] = initial;
+	}
+	
+	static void fill(T *, long long unsigned, const T &, std::false_type) {}
+	
+	void allocate()
+	{
+		values = new std::atomic<T*>[rows];
 		assert(values != NULL);
-		array = new T[y_size];
+		array = NULL;
+		
+		if (lazy) {
+			for (long long unsigned i = 0; i < rows; i++) values[i].store(NULL, std::memory_order_relaxed);
+			return;
+		}
+		
+		long long unsigned y_size = estimate(n, w);
+		if (directory != NULL || shared) {
+			mapped_bytes = y_size * sizeof(T);
+			array = (T*)(shared ? map_shared(mapped_bytes) : map_scratch(directory, mapped_bytes));
+			place_rows(array);
+			return;
+		}
+		
+		array = value_init ? new T[y_size]() : new T[y_size];
 		assert(array != NULL);
+		place_rows(array);
+	}
+	
+	// points the rows to consecutive values from p in the order of range_k_iterator
+	void place_rows(T *p)
+	{
+		for (long long unsigned i = 0; i < rows; i++) values[i].store(NULL, std::memory_order_relaxed);
+		for (range_k_iterator<uintset> it(n, w, uintset::empty(n), uintset::complete(n)); it.has_next(); ++it) {
+			values[slot(it.set().bits)].store(p, std::memory_order_relaxed);
+			p += size(it.set().bits);
+		}
+	}
+	
+	// the position of the row pointer of x
+	long long unsigned slot(set_word x) const
+	{
+		return set_index(uintset(x), w);
+	}
+	
+	// the number of values in the row of x
+	long long unsigned size(set_word x) const
+	{
+		return 1ull << (n - uintset(x).cardinality(n));
+	}
+	
+	// returns the row of x if it has been allocated, otherwise NULL
+	T *allocated_row(set_word x)
+	{
+		return values[slot(x)].load(std::memory_order_acquire);
+	}
+	
+	// returns the row of x, allocating it if needed
+	T *row(set_word x)
+	{
+		std::atomic<T*> &pointer = values[slot(x)];
+		T *p = pointer.load(std::memory_order_acquire);
+		if (p != NULL) return p;
 		
-		for (unsigned i = 0; i < y_size; i++) {
-			array[i] = initial;
+		long long unsigned size = this->size(x);
+		if (value_init) {
+			p = new T[size]();
+		} else {
+			p = new T[size];
+			fill(p, size, initial, typename std::is_copy_assignable<T>::type());
 		}
 		
-		T *p = array;
-		for (unsigned i = 0; i < x_size; i++) {
-			unsigned k = uintset(i).cardinality(n);
-			if (k > w) {
-				values[i] = NULL;
-				continue;
+		// another thread may have allocated the row in the meantime
+		T *expected = NULL;
+		if (!pointer.compare_exchange_strong(expected, p, std::memory_order_acq_rel)) {
+			delete [] p;
+			return expected;
+		}
+		return p;
+	}
+	
+	// returns the number of values allocated
+	long long unsigned allocated()
+	{
+		long long unsigned size = 0;
+		for (range_k_iterator<uintset> it(n, w, uintset::empty(n), uintset::complete(n)); it.has_next(); ++it) {
+			if (allocated_row(it.set().bits) != NULL) size += this->size(it.set().bits);
+		}
+		return size;
+	}
+	
+	// returns the number of allocated values that differ from initial, i.e.,
+	// the entries that have been filled
+	long long unsigned filled(T initial)
+	{
+		long long unsigned count = 0;
+		for (range_k_iterator<uintset> it(n, w, uintset::empty(n), uintset::complete(n)); it.has_next(); ++it) {
+			T *p = allocated_row(it.set().bits);
+			if (p == NULL) continue;
+			long long unsigned size = this->size(it.set().bits);
+			for (long long unsigned u = 0; u < size; u++) {
+				if (p[u] != initial) count++;
 			}
-			values[i] = p;
-			p += (1 << (n - k));
 		}
+		return count;
 	}
 	
 	// maps y to a "short index" using only n - b bits where b is the number of 1s in x
-	unsigned index(unsigned x, unsigned y)
+	long long unsigned index(set_word x, set_word y)
 	{
-		unsigned ind = 0;	// short index of y
+		set_word ind = 0;	// short index of y
 		unsigned j = 0;		// position in the index of y
-		unsigned s = 1;		// we maintain s = 1 << i
-		unsigned r = 1;		// we maintain r = 1 << j
+		set_word s = 1;		// we maintain s = 1 << i
+		set_word r = 1;		// we maintain r = 1 << j
 		for (unsigned i = 0; i < n; i++, s <<= 1) {
 			if (x & s) continue;				// skip 1-bits of x
 			ind |= (r & ((y & s) >> (i - j)));	// if (y & s) ind |= r;
@@ -550,20 +870,42 @@ struct DisjointPairArray
 		return ind;
 	}
 	
-	T get(unsigned x, unsigned y)
+	T get(set_word x, set_word y)
 	{
-		return values[x][index(x, y)];
+		return get_short(x, index(x, y));
 	}
 	
-	void set(unsigned x, unsigned y, T value)
+	void set(set_word x, set_word y, T value)
 	{
-		values[x][index(x, y)] = value;
+		row(x)[index(x, y)] = value;
+	}
+	
+	// the same by the short index u of y
+	T get_short(set_word x, long long unsigned u)
+	{
+		T *p = allocated_row(x);
+		if (p == NULL) return initial;
+		return p[u];
+	}
+	
+	void set_short(set_word x, long long unsigned u, T value)
+	{
+		row(x)[u] = value;
+	}
+	
+	T& at(set_word x, set_word y)
+	{
+		return row(x)[index(x, y)];
 	}
 	
 	~DisjointPairArray()
 	{
+		if (lazy) {
+			for (long long unsigned i = 0; i < rows; i++) delete [] values[i].load(std::memory_order_relaxed);
+		}
 		delete [] values;
-		delete [] array;
+		if (mapped_bytes > 0) unmap_scratch(array, mapped_bytes);
+		else delete [] array;
 	}
 };
 
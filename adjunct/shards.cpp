@@ -0,0 +1,144 @@
+/*
+ *  Adjunct
+ *  
+ *  Copyright 2015 Kustaa Kangas <jwkangas(at)cs.helsinki.fi>
+ *  
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *  
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *  
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <cstdio>
+#include <cstdlib>
+#include <algorithm>
+#include <csignal>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/prctl.h>
+#include <sys/wait.h>
+
+#include "shards.hpp"
+
+
+// A worker that fails leaves the others waiting on the barrier forever, so the
+// coordinator stops as soon as one does.
+static void worker_stopped(int)
+{
+	int status;
+	while (waitpid(-1, &status, WNOHANG) > 0) {
+		if (WIFEXITED(status) && WEXITSTATUS(status) == 0) continue;
+		const char message[] = "Error: A worker process failed.\n";
+		if (write(STDOUT_FILENO, message, sizeof(message) - 1) < 0) {}
+		_exit(1);
+	}
+}
+
+// pins process i of count to the i-th of count equal groups of its CPUs
+static void pin(unsigned i, unsigned count)
+{
+	cpu_set_t allowed;
+	if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0) return;
+	
+	// the CPUs as (package, number)
+	std::vector<std::pair<int, int> > cpus;
+	for (int c = 0; c < CPU_SETSIZE; c++) {
+		if (!CPU_ISSET(c, &allowed)) continue;
+		
+		int package = 0;
+		char path[128];
+		snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%i/topology/physical_package_id", c);
+		FILE *f = fopen(path, "r");
+		if (f != NULL) {
+			if (fscanf(f, "%i", &package) != 1) package = 0;
+			fclose(f);
+		}
+		cpus.push_back(std::make_pair(package, c));
+	}
+	
+	// with fewer CPUs than processes, the scheduler places them
+	if (cpus.size() < count) return;
+	std::sort(cpus.begin(), cpus.end());
+	
+	cpu_set_t group;
+	CPU_ZERO(&group);
+	for (size_t j = cpus.size() * i / count; j < cpus.size() * (i + 1) / count; j++) {
+		CPU_SET(cpus[j].second, &group);
+	}
+	sched_setaffinity(0, sizeof(group), &group);
+}
+
+
+Shards::Shards(unsigned count) : index(0), count(count)
+{
+	barrier = (pthread_barrier_t*)mmap(NULL, sizeof(pthread_barrier_t), PROT_READ | PROT_WRITE,
+		MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if (barrier == MAP_FAILED) {
+		printf("Error: Could not map a barrier for the worker processes\n");
+		exit(1);
+	}
+	
+	pthread_barrierattr_t attr;
+	pthread_barrierattr_init(&attr);
+	pthread_barrierattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+	pthread_barrier_init(barrier, &attr, count);
+	pthread_barrierattr_destroy(&attr);
+	
+	// output buffered so far would be written by each process
+	fflush(stdout);
+	signal(SIGCHLD, worker_stopped);
+	
+	pid_t coordinator = getpid();
+	for (unsigned i = 1; i < count; i++) {
+		pid_t pid = fork();
+		if (pid < 0) {
+			printf("Error: Could not start a worker process\n");
+			exit(1);
+		}
+		if (pid == 0) {
+			index = i;
+			workers.clear();
+			signal(SIGCHLD, SIG_DFL);
+			
+			// a worker does not outlive the coordinator
+			prctl(PR_SET_PDEATHSIG, SIGKILL);
+			if (getppid() != coordinator) _exit(1);
+			break;
+		}
+		workers.push_back(pid);
+	}
+	
+	pin(index, count);
+}
+
+void Shards::wait()
+{
+	pthread_barrier_wait(barrier);
+}
+
+void Shards::finish()
+{
+	if (index > 0) _exit(0);
+	
+	signal(SIGCHLD, SIG_DFL);
+	for (unsigned i = 0; i < workers.size(); i++) {
+		int status;
+		if (waitpid(workers[i], &status, 0) == workers[i] && !(WIFEXITED(status) && WEXITSTATUS(status) == 0)) {
+			printf("Error: A worker process failed.\n");
+			exit(1);
+		}
+	}
+	
+	pthread_barrier_destroy(barrier);
+	munmap(barrier, sizeof(pthread_barrier_t));
+}
@@ -0,0 +1,53 @@
+/*
+ *  Adjunct
+ *  
+ *  Copyright 2015 Kustaa Kangas <jwkangas(at)cs.helsinki.fi>
+ *  
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *  
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *  
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef SHARDS_HPP
+#define SHARDS_HPP
+
+#include <vector>
+#include <pthread.h>
+#include <sys/types.h>
+
+
+// The processes that fill the tables bottom-up together (--procs): the calling
+// process, which coordinates, and workers forked from it. Each process knows
+// its index and runs the same loops, doing its own share of the items of each
+// loop and waiting for the others on a barrier in shared memory. The tables
+// are mapped shared before the workers are forked, so all processes write to
+// the same tables. Each process is pinned to its own group of CPUs, ordered
+// by package, so that with one process per socket each gets a socket.
+struct Shards
+{
+	unsigned index, count;
+	pthread_barrier_t *barrier;
+	std::vector<pid_t> workers;
+	
+	// forks count - 1 workers, returns in each process
+	Shards(unsigned count);
+	
+	// waits for all processes to reach the barrier
+	void wait();
+	
+	// the workers exit, and the coordinator returns when all of them have
+	void finish();
+};
+
+
+#endif
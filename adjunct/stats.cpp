@@ -0,0 +1,179 @@
+/*
+ *  Adjunct
+ *  
+ *  Copyright 2015 Kustaa Kangas <jwkangas(at)cs.helsinki.fi>
+ *  
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *  
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *  
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <cstdio>
+#include <cstring>
+#include <chrono>
+#include <mutex>
+#include <vector>
+#include <algorithm>
+
+#include "stats.hpp"
+
+#ifdef ADJUNCT_STATS
+
+// 0 for no report, 1 for text, 2 for json
+static int stats_format = 0;
+
+static const char *table_names[STAT_TABLES] = { "f", "g", "h" };
+static const char *phase_names[STAT_PHASES] = { "read", "allocate", "dp", "search", "output", "free" };
+
+// the counters of the running threads, and the sums of those that have exited
+struct StatRegistry
+{
+	std::mutex mutex;
+	std::vector<StatCounters*> threads;
+	unsigned long long hits[STAT_TABLES], misses[STAT_TABLES], terms[STAT_TABLES];
+	
+	StatRegistry() : hits(), misses(), terms() {}
+	
+	void add(const StatCounters &c)
+	{
+		for (unsigned i = 0; i < STAT_TABLES; i++) {
+			hits[i] += c.hits[i];
+			misses[i] += c.misses[i];
+			terms[i] += c.terms[i];
+		}
+	}
+};
+
+// constructed on first use, since threads may register before main
+static StatRegistry &registry()
+{
+	static StatRegistry r;
+	return r;
+}
+
+thread_local StatCounters stat_counters;
+
+StatCounters::StatCounters() : hits(), misses(), terms()
+{
+	StatRegistry &r = registry();
+	std::lock_guard<std::mutex> lock(r.mutex);
+	r.threads.push_back(this);
+}
+
+StatCounters::~StatCounters()
+{
+	StatRegistry &r = registry();
+	std::lock_guard<std::mutex> lock(r.mutex);
+	r.add(*this);
+	r.threads.erase(std::find(r.threads.begin(), r.threads.end(), this));
+}
+
+
+typedef std::chrono::steady_clock Clock;
+
+static double phase_times[STAT_PHASES];
+static int current_phase = -1;
+static Clock::time_point phase_start;
+
+// ends the current phase and starts the given one (called by the main thread)
+void stat_phase(StatPhase phase)
+{
+	Clock::time_point now = Clock::now();
+	if (current_phase >= 0) {
+		phase_times[current_phase] += std::chrono::duration<double>(now - phase_start).count();
+	}
+	current_phase = phase;
+	phase_start = now;
+}
+
+
+// entries filled and allocated, and the size of the whole table, summed over
+// all the tables of each kind used by the run
+static long long unsigned table_filled[STAT_TABLES], table_allocated[STAT_TABLES], table_size[STAT_TABLES];
+
+void stat_table(StatTable table, long long unsigned filled, long long unsigned allocated, long long unsigned size)
+{
+	table_filled[table] += filled;
+	table_allocated[table] += allocated;
+	table_size[table] += size;
+}
+
+
+int select_stats(const char *format)
+{
+	if (!strcmp(format, "text")) stats_format = 1;
+	else if (!strcmp(format, "json")) stats_format = 2;
+	else return 0;
+	return 1;
+}
+
+void print_stats()
+{
+	if (stats_format == 0) return;
+	
+	if (current_phase >= 0) stat_phase((StatPhase)current_phase);
+	
+	// the exited threads and the running ones
+	StatRegistry &r = registry();
+	std::lock_guard<std::mutex> lock(r.mutex);
+	StatRegistry total;
+	for (unsigned i = 0; i < STAT_TABLES; i++) {
+		total.hits[i] = r.hits[i];
+		total.misses[i] = r.misses[i];
+		total.terms[i] = r.terms[i];
+	}
+	for (unsigned i = 0; i < r.threads.size(); i++) total.add(*r.threads[i]);
+	
+	if (stats_format == 2) {
+		fprintf(stderr, "{\"phases\": {");
+		for (unsigned i = 0; i < STAT_PHASES; i++) {
+			fprintf(stderr, "%s\"%s\": %.6f", i ? ", " : "", phase_names[i], phase_times[i]);
+		}
+		fprintf(stderr, "}, \"tables\": {");
+		for (unsigned i = 0; i < STAT_TABLES; i++) {
+			fprintf(stderr, "%s\"%s\": {\"calls\": %llu, \"hits\": %llu, \"misses\": %llu, \"terms\": %llu, "
+				"\"filled\": %llu, \"allocated\": %llu, \"size\": %llu}", i ? ", " : "", table_names[i],
+				total.hits[i] + total.misses[i], total.hits[i], total.misses[i], total.terms[i],
+				table_filled[i], table_allocated[i], table_size[i]);
+		}
+		fprintf(stderr, "}}\n");
+		return;
+	}
+	
+	fprintf(stderr, "====================================== Statistics\n");
+	double total_time = 0;
+	for (unsigned i = 0; i < STAT_PHASES; i++) total_time += phase_times[i];
+	for (unsigned i = 0; i < STAT_PHASES; i++) {
+		fprintf(stderr, "%-9s %10.3f s  %5.1f %%\n", phase_names[i], phase_times[i],
+			total_time > 0 ? 100 * phase_times[i] / total_time : 0.0);
+	}
+	fprintf(stderr, "\n%-5s %14s %14s %14s %14s %14s %14s %14s\n", "table", "calls", "hits", "misses",
+		"terms", "filled", "allocated", "size");
+	for (unsigned i = 0; i < STAT_TABLES; i++) {
+		fprintf(stderr, "%-5s %14llu %14llu %14llu %14llu %14llu %14llu %14llu\n", table_names[i],
+			total.hits[i] + total.misses[i], total.hits[i], total.misses[i], total.terms[i],
+			table_filled[i], table_allocated[i], table_size[i]);
+	}
+}
+
+#else
+
+int select_stats(const char *)
+{
+	return 0;
+}
+
+void print_stats()
+{
+}
+
+#endif
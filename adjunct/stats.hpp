@@ -0,0 +1,76 @@
+/*
+ *  Adjunct
+ *  
+ *  Copyright 2015 Kustaa Kangas <jwkangas(at)cs.helsinki.fi>
+ *  
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *  
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *  
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef STATS_HPP
+#define STATS_HPP
+
+
+// Runtime statistics of a run, reported by --stats: the reads of each DP
+// table that found the entry already computed (hits) or had to compute it
+// (misses), the terms summed by the recurrences of each table, the entries
+// filled and allocated in each table, and the wall time of each phase. They
+// are collected only when built with ADJUNCT_STATS (make stats); otherwise
+// the STAT_ macros expand to nothing and the counters cost nothing.
+//
+// The counters are kept separately by each thread and merged when reported.
+// With several processes (--procs), only the coordinator is counted.
+
+enum StatTable { STAT_F = 0, STAT_G, STAT_H, STAT_TABLES };
+enum StatPhase { PHASE_READ = 0, PHASE_ALLOCATE, PHASE_DP, PHASE_SEARCH, PHASE_OUTPUT, PHASE_FREE, STAT_PHASES };
+
+#ifdef ADJUNCT_STATS
+
+struct StatCounters
+{
+	unsigned long long hits[STAT_TABLES], misses[STAT_TABLES], terms[STAT_TABLES];
+	
+	StatCounters();
+	~StatCounters();
+};
+
+extern thread_local StatCounters stat_counters;
+
+void stat_phase(StatPhase phase);
+void stat_table(StatTable table, long long unsigned filled, long long unsigned allocated, long long unsigned size);
+
+#define STAT_HIT(table) (stat_counters.hits[table]++)
+#define STAT_MISS(table) (stat_counters.misses[table]++)
+#define STAT_TERM(table) (stat_counters.terms[table]++)
+#define STAT_PHASE(phase) stat_phase(phase)
+#define STAT_TABLE(table, array, initial, size) stat_table(table, (array)->filled(initial), (array)->allocated(), size)
+
+#else
+
+#define STAT_HIT(table)
+#define STAT_MISS(table)
+#define STAT_TERM(table)
+#define STAT_PHASE(phase)
+#define STAT_TABLE(table, array, initial, size)
+
+#endif
+
+// selects the format of the report, text or json; returns 0 if the format is
+// unknown or the statistics are not collected in this build
+int select_stats(const char *format);
+
+// prints the report to standard error, if one was requested
+void print_stats();
+
+
+#endif
@@ -0,0 +1,158 @@
+/*
+ *  Adjunct
+ *  
+ *  Copyright 2015 Kustaa Kangas <jwkangas(at)cs.helsinki.fi>
+ *  
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *  
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *  
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <cstring>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "tablefile.hpp"
+#include "logsumexp.hpp"
+
+
+// the mapping of the loaded tables
+void *loaded_tables = NULL;
+size_t loaded_bytes = 0;
+
+
+// FNV-1a hash of N, W and the local scores of the sets of size at most W,
+// which are all that the tables depend on
+unsigned long long score_hash()
+{
+	unsigned long long hash = 14695981039346656037ull;
+	
+	unsigned header[2] = { N, W };
+	const unsigned char *p = (const unsigned char*)header;
+	for (unsigned i = 0; i < sizeof(header); i++) hash = (hash ^ p[i]) * 1099511628211ull;
+	
+	for (range_k_iterator<Set> it(N, W, Set::empty(N), Set::complete(N)); it.has_next(); ++it) {
+		p = (const unsigned char*)&local_score(it.set());
+		for (unsigned i = 0; i < sizeof(double); i++) hash = (hash ^ p[i]) * 1099511628211ull;
+	}
+	
+	return hash;
+}
+
+
+// removes a table file, but not a device or other special file of the name
+void remove_table_file(const char *file)
+{
+	struct stat st;
+	if (stat(file, &st) == 0 && S_ISREG(st.st_mode)) unlink(file);
+}
+
+// Creates a table file and writes its header, returns NULL on failure. An
+// existing file is removed first, so that it is not truncated under a mapping
+// of it by load_tables (as update saves the tables it loaded).
+FILE *create_table_file(const char *file, const char *semiring, unsigned value_size)
+{
+	remove_table_file(file);
+	FILE *f = fopen(file, "wb");
+	if (f == NULL) {
+		printf("Error: Could not write the tables to %s\n", file);
+		return NULL;
+	}
+	
+	char page[TABLE_DATA_OFFSET];
+	memset(page, 0, sizeof(page));
+	
+	TableHeader *header = (TableHeader*)page;
+	strcpy(header->magic, TABLE_MAGIC);
+	strncpy(header->semiring, semiring, sizeof(header->semiring) - 1);
+	if (!strcmp(semiring, "sum")) strncpy(header->logsum, logsumexp_mode(), sizeof(header->logsum) - 1);
+	header->n = N;
+	header->w = W;
+	header->value_size = value_size;
+	header->score_hash = score_hash();
+	header->values = DisjointPairArray<double>::estimate(N, W);
+	
+	if (fwrite(page, 1, sizeof(page), f) != sizeof(page)) {
+		printf("Error: Could not write the tables to %s\n", file);
+		fclose(f);
+		remove_table_file(file);
+		return NULL;
+	}
+	return f;
+}
+
+
+// Maps the tables of a table file privately, so that entries computed later
+// are not written back. Exits if the file does not match the scores, W, the
+// semiring or the log-sum-exp mode of sum tables. Returns the tables one after another, each of
+// estimate(N, W) values of value_size bytes.
+void *load_tables(const char *file, const char *semiring, unsigned &value_size)
+{
+	int fd = open(file, O_RDONLY);
+	if (fd < 0) {
+		printf("Error: Could not read the tables from %s\n", file);
+		exit(1);
+	}
+	
+	TableHeader header;
+	struct stat st;
+	if (read(fd, &header, sizeof(header)) != sizeof(header) || fstat(fd, &st) != 0 ||
+		memcmp(header.magic, TABLE_MAGIC, sizeof(TABLE_MAGIC))) {
+		printf("Error: %s is not a table file.\n", file);
+		exit(1);
+	}
+	
+	// the names are read from the file, which need not end them
+	header.semiring[sizeof(header.semiring) - 1] = '\0';
+	header.logsum[sizeof(header.logsum) - 1] = '\0';
+	
+	if (strcmp(header.semiring, semiring)) {
+		printf("Error: %s has %s tables, but %s tables are needed.\n", file, header.semiring, semiring);
+		exit(1);
+	}
+	if (!strcmp(semiring, "sum") && strcmp(header.logsum, logsumexp_mode())) {
+		printf("Error: The tables in %s were summed with --logsum=%s, not %s.\n", file, header.logsum,
+			logsumexp_mode());
+		exit(1);
+	}
+	if (header.n != N || header.w != W || header.score_hash != score_hash()) {
+		printf("Error: The tables in %s were computed for other scores or maximum width (%u).\n",
+			file, header.w);
+		exit(1);
+	}
+	
+	loaded_bytes = TABLE_DATA_OFFSET + 3 * header.values * header.value_size;
+	if ((size_t)st.st_size != loaded_bytes) {
+		printf("Error: %s is truncated.\n", file);
+		exit(1);
+	}
+	
+	loaded_tables = mmap(NULL, loaded_bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (loaded_tables == MAP_FAILED) {
+		printf("Error: Could not map the tables from %s\n", file);
+		exit(1);
+	}
+	
+	vbprintf("Loaded %s tables from %s\n", semiring, file);
+	value_size = header.value_size;
+	return (char*)loaded_tables + TABLE_DATA_OFFSET;
+}
+
+void unload_tables()
+{
+	if (loaded_tables == NULL) return;
+	munmap(loaded_tables, loaded_bytes);
+	loaded_tables = NULL;
+}
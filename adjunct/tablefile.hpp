@@ -0,0 +1,106 @@
+/*
+ *  Adjunct
+ *  
+ *  Copyright 2015 Kustaa Kangas <jwkangas(at)cs.helsinki.fi>
+ *  
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *  
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *  
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef TABLEFILE_HPP
+#define TABLEFILE_HPP
+
+#include "common.hpp"
+
+
+// A file of the DP tables f, g and h of one semiring: a header, padded to
+// TABLE_DATA_OFFSET bytes, followed by the three tables. Each table has the
+// rows of all x with |x| <= W in the order of range_k_iterator, as in
+// ALLOCATE_MAPPED, so the file can be mapped back and used in place. Entries
+// that were not computed (top-down) keep their initial value and are computed
+// on demand after loading. The score hash ties the tables to the scores, and
+// sum tables also record the --logsum mode they were summed in.
+struct TableHeader
+{
+	char magic[8];
+	char semiring[8];
+	char logsum[8];
+	unsigned n, w;
+	unsigned value_size;
+	unsigned long long score_hash;
+	unsigned long long values;
+};
+
+#define TABLE_MAGIC "ADJTBL2"
+#define TABLE_DATA_OFFSET 4096
+
+unsigned long long score_hash();
+FILE *create_table_file(const char *file, const char *semiring, unsigned value_size);
+void remove_table_file(const char *file);
+void *load_tables(const char *file, const char *semiring, unsigned &value_size);
+void unload_tables();
+
+
+// Writes the rows of a table, with the initial value for rows not allocated.
+// Returns 1 if a row could not be written (e.g. the disk is full).
+template <typename T>
+int write_table(FILE *f, DisjointPairArray<T> *a)
+{
+	std::vector<T> initial;
+	for (range_k_iterator<Set> it(N, W, Set::empty(N), Set::complete(N)); it.has_next(); ++it) {
+		long long unsigned size = a->size(it.set().bits);
+		T *p = a->allocated_row(it.set().bits);
+		if (p == NULL) {
+			initial.assign(size, a->initial);
+			p = initial.data();
+		}
+		if (fwrite(p, sizeof(T), size, f) != size) return 1;
+	}
+	return 0;
+}
+
+inline int write_table(FILE *f, ScoreArray *a)
+{
+	if (a->doubles) return write_table(f, a->doubles);
+	else return write_table(f, a->floats);
+}
+
+template <typename T>
+unsigned value_size(DisjointPairArray<T> *)
+{
+	return sizeof(T);
+}
+
+inline unsigned value_size(ScoreArray *a)
+{
+	return a->doubles ? sizeof(double) : sizeof(float);
+}
+
+template <typename Array>
+void save_tables(const char *file, const char *semiring, Array *f_values, Array *g_values, Array *h_values)
+{
+	vbprintf("Saving tables to %s...\n", file);
+	
+	FILE *f = create_table_file(file, semiring, value_size(f_values));
+	if (f == NULL) return;
+	
+	// a partly written file is removed rather than left to be loaded
+	int failed = write_table(f, f_values) || write_table(f, g_values) || write_table(f, h_values);
+	if (fclose(f) != 0 || failed) {
+		printf("Error: Could not write the tables to %s\n", file);
+		remove_table_file(file);
+	}
+}
+
+
+#endif
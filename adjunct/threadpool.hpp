@@ -0,0 +1,188 @@
+/*
+ *  Adjunct
+ *  
+ *  Copyright 2015 Kustaa Kangas <jwkangas(at)cs.helsinki.fi>
+ *  
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *  
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *  
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef THREADPOOL_HPP
+#define THREADPOOL_HPP
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+#include <deque>
+
+
+// A fixed set of worker threads for running parallel loops. The calling thread
+// takes part in each loop, so a pool of n threads starts n-1 workers.
+struct ThreadPool
+{
+	std::vector<std::thread> workers;
+	std::mutex mutex;
+	std::condition_variable start_cv, done_cv;
+	
+	// current loop: items [0, n_items) are handed out in order through next_item
+	std::function<void(size_t)> body;
+	size_t n_items;
+	std::atomic<size_t> next_item;
+	
+	// number of the current loop, workers wait for it to change
+	unsigned long long generation;
+	
+	// number of workers still working on the current loop
+	unsigned busy;
+	
+	bool stopping;
+	
+	ThreadPool(unsigned n_threads) : n_items(0), next_item(0), generation(0), busy(0), stopping(false)
+	{
+		for (unsigned i = 1; i < n_threads; i++) {
+			workers.push_back(std::thread(&ThreadPool::work, this));
+		}
+	}
+	
+	~ThreadPool()
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			stopping = true;
+		}
+		start_cv.notify_all();
+		for (unsigned i = 0; i < workers.size(); i++) workers[i].join();
+	}
+	
+	unsigned size() const
+	{
+		return workers.size() + 1;
+	}
+	
+	// processes items of the current loop until none are left
+	void process()
+	{
+		for (size_t i = next_item++; i < n_items; i = next_item++) body(i);
+	}
+	
+	void work()
+	{
+		unsigned long long seen = 0;
+		
+		while (true) {
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				start_cv.wait(lock, [&] { return stopping || generation != seen; });
+				if (stopping) return;
+				seen = generation;
+			}
+			
+			process();
+			
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				busy--;
+			}
+			done_cv.notify_one();
+		}
+	}
+	
+	// calls f(i) for each i in [0, n), distributing the items dynamically over
+	// all threads, and returns once all of them have been processed
+	void run(size_t n, std::function<void(size_t)> f)
+	{
+		if (workers.empty()) {
+			for (size_t i = 0; i < n; i++) f(i);
+			return;
+		}
+		
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			body = f;
+			n_items = n;
+			next_item = 0;
+			busy = workers.size();
+			generation++;
+		}
+		start_cv.notify_all();
+		
+		process();
+		
+		std::unique_lock<std::mutex> lock(mutex);
+		done_cv.wait(lock, [&] { return busy == 0; });
+	}
+};
+
+
+// One double-ended queue of tasks per thread for work stealing. Each thread
+// pushes and pops its own tasks at the back (depth-first) and, when its own
+// queue is empty, steals the oldest task from the front of another queue.
+template <typename Task>
+struct WorkDeques
+{
+	struct Deque
+	{
+		std::mutex mutex;
+		std::deque<Task> tasks;
+	};
+	
+	std::vector<Deque> deques;
+	
+	WorkDeques(unsigned n_threads) : deques(n_threads) {}
+	
+	// pushes a task to be run next by thread i
+	void push(unsigned i, const Task &task)
+	{
+		std::lock_guard<std::mutex> lock(deques[i].mutex);
+		deques[i].tasks.push_back(task);
+	}
+	
+	// pushes a task to be run by thread i after all of its other tasks
+	void defer(unsigned i, const Task &task)
+	{
+		std::lock_guard<std::mutex> lock(deques[i].mutex);
+		deques[i].tasks.push_front(task);
+	}
+	
+	// takes the next task of thread i, or steals one from another thread;
+	// returns false if no task was found
+	bool pop(unsigned i, Task &task)
+	{
+		{
+			std::lock_guard<std::mutex> lock(deques[i].mutex);
+			if (!deques[i].tasks.empty()) {
+				task = deques[i].tasks.back();
+				deques[i].tasks.pop_back();
+				return true;
+			}
+		}
+		
+		for (unsigned j = 1; j < deques.size(); j++) {
+			Deque &victim = deques[(i + j) % deques.size()];
+			std::lock_guard<std::mutex> lock(victim.mutex);
+			if (!victim.tasks.empty()) {
+				task = victim.tasks.front();
+				victim.tasks.pop_front();
+				return true;
+			}
+		}
+		
+		return false;
+	}
+};
+
+
+#endif
@@ -18,7 +18,14 @@
  */
 
 #include <cstdlib>
+#include <cstdio>
 #include <cmath>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/time.h>
+#include <unistd.h>
 
 #include "tools.hpp"
 
@@ -33,7 +40,142 @@ double logsum(double x, double y)
 	}
 }
 
+// the generator of rnd() in threads that have seeded their own, which gives
+// the same numbers as rand() after srand() with the same seed
+thread_local struct random_data thread_random;
+thread_local char thread_random_state[128];
+thread_local bool thread_random_seeded = false;
+
 double rnd()
 {
+	if (thread_random_seeded) {
+		int32_t r;
+		random_r(&thread_random, &r);
+		return r / ((double)RAND_MAX + 1);
+	}
 	return rand() / ((double)RAND_MAX + 1);
 }
+
+void seed_thread_rnd(unsigned seed)
+{
+	memset(&thread_random, 0, sizeof(thread_random));
+	initstate_r(seed, thread_random_state, sizeof(thread_random_state), &thread_random);
+	thread_random_seeded = true;
+}
+
+
+// Maps a new scratch file of the given size in the directory. The file is
+// unlinked right away, so it is removed when it is unmapped or the process
+// exits, and the kernel writes its pages back to the file under memory
+// pressure instead of swapping.
+void *map_scratch(const char *directory, size_t bytes)
+{
+	char path[4096];
+	snprintf(path, sizeof(path), "%s/adjunct-XXXXXX", directory);
+	
+	int fd = mkstemp(path);
+	if (fd < 0) {
+		printf("Error: Could not create a scratch file in %s\n", directory);
+		exit(1);
+	}
+	unlink(path);
+	
+	if (ftruncate(fd, bytes) != 0) {
+		printf("Error: Could not extend a scratch file to %zu bytes\n", bytes);
+		exit(1);
+	}
+	
+	void *p = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (p == MAP_FAILED) {
+		printf("Error: Could not map a scratch file of %zu bytes\n", bytes);
+		exit(1);
+	}
+	
+	return p;
+}
+
+// Maps a new POSIX shared memory segment of the given size, which processes
+// forked afterwards share. Its name is unlinked right away, so it is removed
+// once all of them have unmapped it or exited.
+void *map_shared(size_t bytes)
+{
+	static unsigned segments = 0;
+	char name[64];
+	snprintf(name, sizeof(name), "/adjunct-%d-%u", (int)getpid(), segments++);
+	
+	int fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+	if (fd < 0) {
+		printf("Error: Could not create a shared memory segment\n");
+		exit(1);
+	}
+	shm_unlink(name);
+	
+	if (ftruncate(fd, bytes) != 0) {
+		printf("Error: Could not extend a shared memory segment to %zu bytes\n", bytes);
+		exit(1);
+	}
+	
+	void *p = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (p == MAP_FAILED) {
+		printf("Error: Could not map a shared memory segment of %zu bytes\n", bytes);
+		exit(1);
+	}
+	
+	return p;
+}
+
+void unmap_scratch(void *p, size_t bytes)
+{
+	munmap(p, bytes);
+}
+
+
+Usage Usage::now()
+{
+	Usage u;
+	
+	struct timeval tp;
+	gettimeofday(&tp, NULL);
+	u.wall = tp.tv_sec + tp.tv_usec / 1000000.0;
+	
+	struct rusage r;
+	getrusage(RUSAGE_SELF, &r);
+	u.user = r.ru_utime.tv_sec + r.ru_utime.tv_usec / 1000000.0;
+	u.system = r.ru_stime.tv_sec + r.ru_stime.tv_usec / 1000000.0;
+	u.major_faults = r.ru_majflt;
+	
+	// bytes actually read from and written to storage, if the kernel reports them
+	u.read_bytes = u.write_bytes = -1;
+	FILE *f = fopen("/proc/self/io", "r");
+	if (f != NULL) {
+		char name[64];
+		long long value;
+		while (fscanf(f, "%63s %lld", name, &value) == 2) {
+			if (!strcmp(name, "read_bytes:")) u.read_bytes = value;
+			if (!strcmp(name, "write_bytes:")) u.write_bytes = value;
+		}
+		fclose(f);
+	}
+	
+	return u;
+}
+
+// prints the time spent computing and waiting (mostly for I/O when the tables
+// do not fit in memory) and the I/O done since start; with several threads,
+// the CPU time may exceed the wall time
+void Usage::print_since(const Usage &start)
+{
+	double wall = this->wall - start.wall;
+	double cpu = (user - start.user) + (system - start.system);
+	
+	printf("Time: %.2f s wall, %.2f s user, %.2f s system, %.2f s waiting\n",
+		wall, user - start.user, system - start.system, wall > cpu ? wall - cpu : 0.0);
+	printf("I/O: %ld major page faults", major_faults - start.major_faults);
+	if (read_bytes >= 0 && start.read_bytes >= 0) {
+		printf(", %.1f MB read, %.1f MB written", (read_bytes - start.read_bytes) / 1048576.0,
+			(write_bytes - start.write_bytes) / 1048576.0);
+	}
+	printf("\n");
+}
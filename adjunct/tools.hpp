@@ -21,10 +21,27 @@
 #define TOOLS_H
 
 #include <limits>
+#include <cstddef>
 
 #define INFTY (std::numeric_limits<double>::infinity())
 
 double logsum(double x, double y);
 double rnd();
+void seed_thread_rnd(unsigned seed);
+
+void *map_scratch(const char *directory, size_t bytes);
+void *map_shared(size_t bytes);
+void unmap_scratch(void *p, size_t bytes);
+
+// resources used by the process so far
+struct Usage
+{
+	double wall, user, system;
+	long major_faults;
+	long long read_bytes, write_bytes;
+	
+	static Usage now();
+	void print_since(const Usage &start);
+};
 
 #endif
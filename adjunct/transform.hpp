@@ -0,0 +1,70 @@
+/*
+ *  Adjunct
+ *  
+ *  Copyright 2015 Kustaa Kangas <jwkangas(at)cs.helsinki.fi>
+ *  
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *  
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *  
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef TRANSFORM_HPP
+#define TRANSFORM_HPP
+
+#include <vector>
+
+
+// Transforms over the subsets of m elements, stored in arrays of size 2^m
+// indexed by the bits of the subsets. For unsigned integers, they are exact
+// modulo 2^bits.
+
+// x(Y) <- sum over X in [Ø,Y] of x(X)
+template <typename T>
+void zeta_transform(std::vector<T> &x, unsigned m)
+{
+	unsigned size = 1 << m;
+	for (unsigned i = 0; i < m; i++) {
+		unsigned b = 1 << i;
+		for (unsigned y = 0; y < size; y++) {
+			if (y & b) x[y] += x[y ^ b];
+		}
+	}
+}
+
+// inverse of zeta_transform
+template <typename T>
+void moebius_transform(std::vector<T> &x, unsigned m)
+{
+	unsigned size = 1 << m;
+	for (unsigned i = 0; i < m; i++) {
+		unsigned b = 1 << i;
+		for (unsigned y = 0; y < size; y++) {
+			if (y & b) x[y] -= x[y ^ b];
+		}
+	}
+}
+
+
+// p(Y) <- sum over j in [1,k] of a_j(Y) b_{k-j}(Y), the ranked product of
+// zeta transforms a_j and b_j of ranks j
+template <typename T>
+void ranked_product(std::vector<std::vector<T> > &a, std::vector<std::vector<T> > &b, unsigned k, std::vector<T> &p)
+{
+	for (unsigned y = 0; y < p.size(); y++) {
+		T sum = 0;
+		for (unsigned j = 1; j <= k; j++) sum += a[j][y] * b[k - j][y];
+		p[y] = sum;
+	}
+}
+
+
+#endif
@@ -0,0 +1,191 @@
+/*
+ *  Adjunct
+ *  
+ *  Copyright 2015 Kustaa Kangas <jwkangas(at)cs.helsinki.fi>
+ *  
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *  
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *  
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <algorithm>
+#include <cstring>
+
+#include "kernel.hpp"
+
+
+TreeNode<Set> *backtrack_max_f(MaxTables &t, Set S, Set R, double score_m, TreeNode<Set> *node);
+
+
+// a new local score of a set
+struct ScoreChange
+{
+	Set X;
+	double score;
+	
+	bool operator<(const ScoreChange &other) const
+	{
+		return X.cardinality(N) < other.X.cardinality(N);
+	}
+};
+
+// reads lines of a set, as an integer as in the compact form, and its new local score
+int read_changes(const char *file, std::vector<ScoreChange> &changes)
+{
+	FILE *f = fopen(file, "r");
+	if (f == NULL) {
+		printf("Error: Could not read: %s\n", file);
+		return 1;
+	}
+	
+	long long unsigned bits;
+	double score;
+	int read;
+	while ((read = fscanf(f, "%llu %lf", &bits, &score)) == 2) {
+		if ((N < 64 && bits >> N) || Set(bits).cardinality(N) > M) {
+			printf("Error: %llu is not a set of at most %u of the %u variables.\n", bits, M, N);
+			fclose(f);
+			return 1;
+		}
+		ScoreChange change = { Set(bits), score };
+		changes.push_back(change);
+	}
+	fclose(f);
+	
+	if (read != EOF) {
+		printf("Error: Expected lines of a set and a score in %s\n", file);
+		return 1;
+	}
+	return 0;
+}
+
+// Changes the local scores and returns the sets whose table entries are to
+// be reset. The entries of a set are among those of its subsets, so the sets
+// are taken in order of size and those with a changed subset are skipped.
+void apply_changes(std::vector<ScoreChange> &changes, std::vector<Set> &reset_sets)
+{
+	std::stable_sort(changes.begin(), changes.end());
+	
+	for (unsigned i = 0; i < changes.size(); i++) {
+		Set X = changes[i].X;
+		local_score(X) = changes[i].score;
+		
+		bool covered = false;
+		for (unsigned j = 0; j < reset_sets.size(); j++) {
+			if (reset_sets[j].subsetof(X)) covered = true;
+		}
+		if (!covered) reset_sets.push_back(X);
+	}
+}
+
+// resets the entries of the tables that depend on the scores of the sets
+template <typename Semiring>
+long long unsigned reset_tables(MemoTables<Semiring> &tables, std::vector<Set> &reset_sets)
+{
+	long long unsigned reset = 0;
+	for (unsigned i = 0; i < reset_sets.size(); i++) reset += invalidate_tables(tables, reset_sets[i]);
+	return reset;
+}
+
+
+// Computes the max and sum tables, or those of one semiring, changes the
+// local scores given in a file, recomputes only the entries that depend on
+// them, and prints an optimal tree and the total score for the new scores.
+// The tables of one semiring can be loaded from a file saved for the old
+// scores by --save-tables, and saved for the new scores.
+void update(const char **argv)
+{
+	if (!*argv) {
+		printf("Missing argument: A file of changed local scores.\n");
+		return;
+	}
+	const char *changes_file = *argv++;
+	
+	bool max = true, sum = true;
+	if (*argv) {
+		if (!strcmp(*argv, "max")) {
+			sum = false;
+		} else if (!strcmp(*argv, "sum")) {
+			max = false;
+		} else {
+			printf("Error: Unknown update tables (max or sum): %s\n", *argv);
+			return;
+		}
+	}
+	if (max && sum && (opt_save_tables != NULL || opt_load_tables != NULL)) {
+		printf("Error: Update loads and saves the tables of max or sum, give one of them.\n");
+		return;
+	}
+	
+	std::vector<ScoreChange> changes;
+	if (read_changes(changes_file, changes)) return;
+	
+	// the tables are saved for the new scores, after the update
+	const char *save_file = opt_save_tables;
+	opt_save_tables = NULL;
+	
+	Usage start = Usage::now();
+	
+	MaxTables max_tables(NULL, NULL, NULL);
+	SumTables sum_tables(NULL, NULL, NULL);
+	double max_score = -INFTY, sum_score = -INFTY;
+	
+	if (max) {
+		allocate_tables(MaxSemiring::name(), max_tables.f_values, max_tables.g_values, max_tables.h_values);
+		vbprintf("\nComputing max tables...\n");
+		max_score = compute_tables(max_tables);
+		vbprintf("Optimum: %f\n", max_score);
+	}
+	if (sum) {
+		allocate_tables(SumSemiring::name(), sum_tables.f_values, sum_tables.g_values, sum_tables.h_values);
+		vbprintf("\nComputing sum tables...\n");
+		sum_score = compute_tables(sum_tables);
+		vbprintf("Total score: %f\n", sum_score);
+	}
+	double full_time = Usage::now().wall - start.wall;
+	
+	vbprintf("\nUpdating %u local scores...\n", (unsigned)changes.size());
+	start = Usage::now();
+	std::vector<Set> reset_sets;
+	apply_changes(changes, reset_sets);
+	
+	long long unsigned reset = 0;
+	if (max) {
+		reset += reset_tables(max_tables, reset_sets);
+		max_score = max_tables.f(Set::empty(N), Set::complete(N));
+	}
+	if (sum) {
+		reset += reset_tables(sum_tables, reset_sets);
+		sum_score = sum_tables.f(Set::empty(N), Set::complete(N));
+	}
+	vbprintf("Entries reset and recomputed: %llu of %llu in %.3f s (the tables took %.3f s)\n", reset,
+		(max + sum) * 3 * SetArray::estimate(N, W), Usage::now().wall - start.wall, full_time);
+	
+	if (save_file != NULL) {
+		if (max) save_tables(save_file, MaxSemiring::name(), max_tables.f_values, max_tables.g_values, max_tables.h_values);
+		else save_tables(save_file, SumSemiring::name(), sum_tables.f_values, sum_tables.g_values, sum_tables.h_values);
+	}
+	
+	if (max) {
+		TreeNode<Set> *root = backtrack_max_f(max_tables, Set::empty(N), Set::complete(N), max_score,
+			(TreeNode<Set>*)NULL);
+		root->output();
+		delete root;
+		deallocate_tables(max_tables.f_values, max_tables.g_values, max_tables.h_values);
+	}
+	if (sum) {
+		if (opt_output_headers) printf("====================================== Total score\n");
+		printf("%f\n", sum_score);
+		deallocate_tables(sum_tables.f_values, sum_tables.g_values, sum_tables.h_values);
+	}
+}
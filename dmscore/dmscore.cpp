@@ -30,6 +30,7 @@
 #include "subsets.hpp"
 #include "subsetscore.hpp"
 #include "boundedsubsetmap.hpp"
+#include "simulate.hpp"
 
 
 /**
@@ -83,10 +84,13 @@ int main(int argc, char** argv) {
 	bool unifiedScores = true;
 	string outFilename = "-";
 	string setOutputOrder = "colex";
+	bool simulate = false;
+	int simVariables = 0, simRecords = 0;
+	unsigned simSeed = 1;
 	
 	// parse options
 	char c;
-	while ((c = getopt(argc, argv, "a:gho:")) != -1) {
+	while ((c = getopt(argc, argv, "a:gho:s:")) != -1) {
 		switch (c) {
 			case 'a':
 				setOutputOrder = optarg;
@@ -107,6 +111,14 @@ int main(int argc, char** argv) {
 			case 'o':
 				outFilename = optarg;
 				break;
+			case 's':
+				simulate = true;
+				if (sscanf(optarg, "%d,%d,%u", &simVariables, &simRecords, &simSeed) < 2 ||
+						simVariables < 1 || simRecords < 1) {
+					fprintf(stderr, "Error: Invalid simulation '%s'.\n", optarg);
+					return 1;
+				}
+				break;
 			case '?':
 				return 1;
 			default:
@@ -116,19 +128,25 @@ int main(int argc, char** argv) {
 	}
 	
 	// print help if requested or wrong number of arguments
-	if (printHelp || argc - optind < 2 || argc - optind > 3) {
+	int nArgs = argc - optind + simulate;
+	if (printHelp || nArgs < 2 || nArgs > 3) {
 		fprintf(stderr,
 			"Syntax: %s [options] <datafile> <equivalent sample size>"
-			" [<max clique size>]\n",
-			argv[0]);
+			" [<max clique size>]\n"
+			"        %s [options] -s <variables>,<records>[,<seed>]"
+			" <equivalent sample size> [<max clique size>]\n"
+			"\n"
+			"With -s, the data are simulated from a random Bayesian network"
+			" instead of read.\n",
+			argv[0], argv[0]);
 		return 1;
 	}
 	
 	// parse input file name
-	string inFilename = argv[optind];
+	string inFilename = simulate ? "" : argv[optind++];
 	
 	// parse ESS
-	double equivalentSampleSize = atof(argv[optind + 1]);
+	double equivalentSampleSize = atof(argv[optind]);
 	if (!(equivalentSampleSize > 0)) {
 		fprintf(stderr, "Error: Invalid equivalent sample size.\n");
 		return 1;
@@ -136,41 +154,46 @@ int main(int argc, char** argv) {
 	
 	// parse max clique size
 	int maxSetSize = - 1;
-	if (argc - optind == 3) {
-		maxSetSize = atoi(argv[optind + 2]);
+	if (nArgs == 3) {
+		maxSetSize = atoi(argv[optind + 1]);
 	}
 	
-	// open the input stream
-	istream inStream(0);
-	ifstream inFile;
-	if (inFilename == "-") {
-		inStream.rdbuf(cin.rdbuf());
+	CategoricalData<int> data;
+	if (simulate) {
+		// simulate the data
+		simulateData(simVariables, simRecords, simSeed, &data);
 	} else {
-		inFile.open(inFilename.c_str());
-		if (!inFile) {
-			fprintf(stderr, "Error: Could not open file '%s' for reading.\n",
-					inFilename.c_str());
+		// open the input stream
+		istream inStream(0);
+		ifstream inFile;
+		if (inFilename == "-") {
+			inStream.rdbuf(cin.rdbuf());
+		} else {
+			inFile.open(inFilename.c_str());
+			if (!inFile) {
+				fprintf(stderr, "Error: Could not open file '%s' for reading.\n",
+						inFilename.c_str());
+				return 1;
+			}
+			inStream.rdbuf(inFile.rdbuf());
+		}
+		
+		// read the data
+		try {
+			readData(inStream, &data);
+		} catch (Exception& e) {
+			fprintf(stderr, "Error: While reading data file '%s': %s\n",
+					inFilename.c_str(), e.what());
 			return 1;
 		}
-		inStream.rdbuf(inFile.rdbuf());
+		if (inFile.is_open())
+			inFile.close();
+		
+		data.detectArities();
 	}
 
-	// read the data
-	CategoricalData<int> data;
-	try {
-		readData(inStream, &data);
-	} catch (Exception& e) {
-		fprintf(stderr, "Error: While reading data file '%s': %s\n",
-				inFilename.c_str(), e.what());
-		return 1;
-	}
-	if (inFile.is_open())
-		inFile.close();
-
 	int nVariables = data.getNumVariables();
 	
-	data.detectArities();
-	
 	// determine max clique size if not set, otherwise validate it
 	if (maxSetSize == -1) {
 		maxSetSize = nVariables;
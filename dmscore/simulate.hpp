@@ -0,0 +1,99 @@
+/*
+ *  Simulation of data from random Bayesian networks
+ *  
+ *  Copyright 2015 Teppo Niinimäki <teppo.niinimaki(at)helsinki.fi>
+ *  
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *  
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *  
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef SIMULATE_HPP
+#define SIMULATE_HPP
+
+#include <random>
+#include <vector>
+#include <algorithm>
+
+#include "data.hpp"
+
+
+/**
+ * Simulates data from a random Bayesian network, so that the scores computed
+ * from it are distributed like those of real data. The variables are put in a
+ * random order, each has an arity of 2 to 4 and up to maxParents parents among
+ * the variables before it, and each row of its conditional probability table
+ * is drawn from a symmetric Dirichlet distribution with concentration 1/2.
+ */
+template <typename T>
+void simulateData(int nVariables, int nRecords, unsigned seed, CategoricalData<T>* data, int maxParents = 2) {
+	std::mt19937 rng(seed);
+	
+	std::vector<int> order(nVariables);
+	for (int i = 0; i < nVariables; ++i)
+		order[i] = i;
+	std::shuffle(order.begin(), order.end(), rng);
+	
+	// the network: arities, parents and the conditional probability tables
+	// with one row of arity[v] probabilities per configuration of the parents
+	std::vector<int> arities(nVariables);
+	std::vector<std::vector<int>> parents(nVariables);
+	std::vector<std::vector<double>> cpts(nVariables);
+	std::gamma_distribution<double> gamma(0.5, 1.0);
+	for (int i = 0; i < nVariables; ++i) {
+		int v = order[i];
+		arities[v] = 2 + rng() % 3;
+		
+		int nParents = std::min(i, (int)(rng() % (maxParents + 1)));
+		std::vector<int> earlier(order.begin(), order.begin() + i);
+		std::shuffle(earlier.begin(), earlier.end(), rng);
+		parents[v].assign(earlier.begin(), earlier.begin() + nParents);
+		
+		int nConfigs = 1;
+		for (int u : parents[v])
+			nConfigs *= arities[u];
+		cpts[v].resize(nConfigs * arities[v]);
+		for (int c = 0; c < nConfigs; ++c) {
+			double* row = &cpts[v][c * arities[v]];
+			double sum = 0;
+			for (int x = 0; x < arities[v]; ++x)
+				sum += row[x] = gamma(rng);
+			for (int x = 0; x < arities[v]; ++x)
+				row[x] /= sum;
+		}
+	}
+	
+	// draw the records in the order of the variables
+	data->resize(nVariables, nRecords);
+	std::uniform_real_distribution<double> uniform(0.0, 1.0);
+	for (int r = 0; r < nRecords; ++r) {
+		for (int v : order) {
+			int c = 0;
+			for (int u : parents[v])
+				c = c * arities[u] + (*data)(u, r);
+			const double* row = &cpts[v][c * arities[v]];
+			double p = uniform(rng);
+			int x = 0;
+			while (x < arities[v] - 1 && p >= row[x]) {
+				p -= row[x];
+				++x;
+			}
+			(*data)(v, r) = x;
+		}
+	}
+	
+	data->setArities(arities);
+}
+
+
+#endif
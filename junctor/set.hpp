@@ -9,20 +9,37 @@
 
 
 
+// The common operations of sets, on top of has() and set() of the set type
+// Set. These are statically dispatched to Set, and sets carry no vtable pointer,
+// unless VIRTUAL_SETS is defined, in which case they are virtual as in the
+// original implementation (with identical results).
+template <typename Set>
 struct base_set
 {
+#ifdef VIRTUAL_SETS
 	virtual bool has(unsigned e) const = 0;
 	virtual void set(unsigned e) = 0;
 	
-	bool operator& (int e) const
+	bool test(unsigned e) const
 	{
 		return has(e);
 	}
+#else
+	bool test(unsigned e) const
+	{
+		return static_cast<const Set*>(this)->has(e);
+	}
+#endif
+	
+	bool operator& (int e) const
+	{
+		return test(e);
+	}
 	
 	void print(int k) const
 	{
 		for (int e = 0; e < k; e++) {
-			printf("%i", has(k-e-1) ? 1 : 0);
+			printf("%i", test(k-e-1) ? 1 : 0);
 		}
 	}
 	
@@ -30,7 +47,7 @@ struct base_set
 	{
 		bool empty = true;
 		for (unsigned e = 0; e < k; e++) {
-			if (has(e)) {
+			if (test(e)) {
 				printf("%c", 'A'+e);
 				empty = false;
 			} else {
@@ -45,7 +62,7 @@ struct base_set
 		bool empty = true;
 		printf("{");
 		for (unsigned e = 0; e < k; e++) {
-			if (!has(e)) continue;
+			if (!test(e)) continue;
 			if (!empty) printf(",");
 			printf("%i", e);
 			empty = false;
@@ -58,7 +75,7 @@ struct base_set
 		bool empty = true;
 		strcat(str, "{");
 		for (unsigned e = 0; e < k; e++) {
-			if (!has(e)) continue;
+			if (!test(e)) continue;
 			if (!empty) strcat(str, ",");
 			char buf[256];
 			sprintf(buf, "%i", e);
@@ -90,14 +107,14 @@ struct base_set
 	{
 		unsigned count = 0;
 		for (int i = 0; i < n; i++) {
-			if (has(i)) count++;
+			if (test(i)) count++;
 		}
 		return count;
 	}
 	
 	bool operator[] (unsigned e) const
 	{
-		return has(e);
+		return test(e);
 	}
 	
 	// returns the index of the first one (among the first k), or k if no such bit
@@ -105,7 +122,7 @@ struct base_set
 	{
 		unsigned i;
 		for (i = 0; i < k; i++) {
-			if (has(i)) break;
+			if (test(i)) break;
 		}
 		return i;
 	}
@@ -114,7 +131,7 @@ struct base_set
 	{
 		unsigned n = 0;
 		for (unsigned i = 0; i < k; i++) {
-			if (has(i)) {
+			if (test(i)) {
 				list[n] = i;
 				n++;
 			}
@@ -124,7 +141,7 @@ struct base_set
 };
 
 template <typename T>
-struct integer_set : base_set
+struct integer_set : base_set<integer_set<T> >
 {
 	T bits;
 	
@@ -208,7 +225,7 @@ struct integer_set : base_set
 	
 	void print(int k)
 	{
-		base_set::print(k);
+		base_set<integer_set>::print(k);
 	}
 	
 	void println()
@@ -218,7 +235,7 @@ struct integer_set : base_set
 	
 	void println(unsigned n)
 	{
-		base_set::println(n);
+		base_set<integer_set>::println(n);
 	}
 	
 	bool operator== (const integer_set& other) const
@@ -251,9 +268,11 @@ typedef integer_set<unsigned int> uintset;
 
 
 
-// An abstract class for iterating over sets. The iteration order depends on the subclass.
-// Must be initialized by a call to init() before making instances.
-template <typename Set>
+// An abstract class for iterating over sets. The iteration order depends on the subclass
+// Iterator, whose next() is statically dispatched unless VIRTUAL_SETS is defined. The
+// binomial coefficients are those of set_iterator<Set>, which must be initialized by a
+// call to init() before making instances.
+template <typename Set, typename Iterator = void>
 struct set_iterator
 {
 	Set S;
@@ -285,6 +304,7 @@ struct set_iterator
 		return index < n_sets;
 	}
 	
+#ifdef VIRTUAL_SETS
 	void operator++ ()
 	{
 		index++;
@@ -292,15 +312,22 @@ struct set_iterator
 	}
 	
 	virtual void next() = 0;
+#else
+	void operator++ ()
+	{
+		index++;
+		static_cast<Iterator*>(this)->next();
+	}
+#endif
 };
 
-template <class Set> long long unsigned set_iterator<Set>::binom[64+1][64+1];
+template <class Set, class Iterator> long long unsigned set_iterator<Set, Iterator>::binom[64+1][64+1];
 
 
 
 // enumerates sets in an interval [A,B] in the lexicographic order
 template <typename Set>
-struct range_iterator : public set_iterator<Set>
+struct range_iterator : public set_iterator<Set, range_iterator<Set> >
 {
 	unsigned int opt_bits[32];	// optional elements in B\A
 	unsigned int obn;
@@ -311,7 +338,8 @@ struct range_iterator : public set_iterator<Set>
 		return (1 << (B.cardinality(n) - A.cardinality(n))) - (end ? 0 : 1);
 	}
 	
-	range_iterator(int n, Set A, Set B, bool start=1, bool end=1) : set_iterator<Set>(A, number_of_sets(n, A, B, end))
+	range_iterator(int n, Set A, Set B, bool start=1, bool end=1) :
+		set_iterator<Set, range_iterator<Set> >(A, number_of_sets(n, A, B, end))
 	{
 		Set C = B ^ A;
 		
@@ -344,7 +372,7 @@ struct range_iterator : public set_iterator<Set>
 
 // enumerates sets of size at most k in an interval [A,B] in the lexicographic order
 template <typename Set>
-struct range_k_iterator : public set_iterator<Set>
+struct range_k_iterator : public set_iterator<Set, range_k_iterator<Set> >
 {
 	unsigned int opt_bits[32];	// optional elements in B\A
 	unsigned int one_bits[32];	// optional bits currently set to one
@@ -372,7 +400,8 @@ struct range_k_iterator : public set_iterator<Set>
 		return sets;
 	}
 	
-	range_k_iterator(unsigned n, unsigned k, Set A, Set B, bool start=1, bool end=1) : set_iterator<Set>(A, number_of_sets(n, k, A, B, end))
+	range_k_iterator(unsigned n, unsigned k, Set A, Set B, bool start=1, bool end=1) :
+		set_iterator<Set, range_k_iterator<Set> >(A, number_of_sets(n, k, A, B, end))
 	{
 		Set C = B ^ A;
 		
@@ -401,7 +430,7 @@ struct range_k_iterator : public set_iterator<Set>
 	
 	void next()
 	{
-		if (set_iterator<Set>::index == set_iterator<Set>::n_sets) return;
+		if (this->index == this->n_sets) return;
 		
 		// starting from the first element, or the first 1 bit if cardinality is full
 		unsigned i = (one_n == opt_k) ? one_bits[one_n-1] : 0;